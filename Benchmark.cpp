@@ -0,0 +1,276 @@
+// Headless benchmark: no window is opened, only the CPU paths are measured. Sweeps particle counts,
+// emitter counts and emitter features, and prints ns per particle for each stage as JSON.
+//
+//   Benchmark                      1k to 10M particles, results on stdout
+//   Benchmark --max 1000000        stop the sweep at 1M particles
+//   Benchmark --out results.json   write the results to a file
+//
+// Stages: "update" is one Emitter::Update of a full emitter, "spawn" one Emitter::Spawn filling an
+// empty one, "sort" one DepthSorter::Sort of every particle, "build" one Emitter::AppendInstances,
+// the transforms and colors DrawMode::Instanced uploads, and "system" one ParticleSystem::Update
+// with the particles split across several emitters. Every figure is the fastest of several runs.
+
+#include "RayParticle3D.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr float frameTime = 1.0f / 60.0f;
+constexpr double minSeconds = 0.2;  // Per measurement, a stage is repeated for at least this long
+constexpr int minRuns = 3;
+
+const char* SimdName() {
+#if defined(RP3D_SIMD_AVX2)
+    return "avx2";
+#elif defined(RP3D_SIMD_SSE)
+    return "sse";
+#elif defined(RP3D_SIMD_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+// Target features the header picks up besides the lane width: F16C converts the compact layout's
+// half floats, FMA fuses the AVX2 multiply-adds
+bool HasF16c() {
+#if !defined(RP3D_NO_SIMD) && defined(__F16C__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool HasFma() {
+#if defined(RP3D_SIMD_AVX2) && defined(__FMA__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+// One emitter setup of the sweep
+struct Case {
+    const char* name;
+    void (*configure)(EmitterConfig& cfg);
+    bool colliders = false;
+    bool affectors = false;
+    bool drawStages = false;  // Also measure sorting and draw-buffer building
+    size_t maxParticles = std::numeric_limits<size_t>::max();
+};
+
+const std::vector<Case>& Cases() {
+    static const std::vector<Case> cases = {
+        // No gravity, attraction, floor or scaling: the cheapest kernel specialization
+        { .name = "plain", .configure = [](EmitterConfig& c) {
+            c.gravity = 0.0f;
+            c.collision = false;
+            c.originAcceleration = { 0.0f, 0.0f };
+            c.scaleByDistance = false;
+        } },
+        { .name = "default", .configure = [](EmitterConfig&) {}, .drawStages = true },
+        { .name = "compact", .configure = [](EmitterConfig& c) { c.layout = ParticleLayout::Compact; }, .drawStages = true },
+        { .name = "parallel", .configure = [](EmitterConfig& c) { c.updateMode = UpdateMode::Parallel; } },
+        { .name = "colliders", .configure = [](EmitterConfig&) {}, .colliders = true },
+        { .name = "affectors", .configure = [](EmitterConfig&) {}, .affectors = true },
+        { .name = "fluid", .configure = [](EmitterConfig& c) {
+            c.interaction.model = InteractionModel::Fluid;
+            // The fountain gets denser with the count, the radius shrinks so each particle keeps
+            // about as many neighbors as with 0.5 at 1k particles
+            c.interaction.radius = 0.5f * std::cbrt(1000.0f / static_cast<float>(c.capacity));
+        }, .maxParticles = 1000000 },
+    };
+    return cases;
+}
+
+// A fountain that keeps about `capacity` particles alive once warmed up
+EmitterConfig BaseConfig(size_t capacity) {
+    EmitterConfig c{};
+    c.direction = { 0.0f, 1.0f, 0.0f };
+    c.velocity = { 1.0f, 3.0f };
+    c.directionAngle = { -30.0f, 30.0f };
+    c.velocityAngle = { -180.0f, 180.0f };
+    c.offset = { 0.0f, 0.5f };
+    c.originAcceleration = { 0.2f, 0.5f };
+    c.age = { 1.0f, 2.0f };
+    c.burst = { 0, 0 };
+    c.capacity = capacity;
+    c.emissionRate = static_cast<size_t>(capacity / 1.5);
+    c.startColor = Color{ 255, 150, 0, 255 };
+    c.endColor = Color{ 255, 50, 0, 0 };
+    c.blendMode = BLEND_ADDITIVE;
+    c.gravity = 0.5f;
+    c.collision = true;
+    c.seed = 1;
+    c.drawMode = DrawMode::Instanced;
+    return c;
+}
+
+ColliderSet& Colliders() {
+    static ColliderSet set = [] {
+        ColliderSet s;
+        s.Add(Collider::Plane({ 0.0f, 1.0f, 0.0f }, -1.0f));
+        for (int i = 0; i < 8; ++i) {
+            float angle = i * PI / 4.0f;
+            s.Add(Collider::Sphere({ 2.0f * std::cos(angle), 0.5f, 2.0f * std::sin(angle) }, 0.5f));
+        }
+        s.Build();
+        return s;
+    }();
+    return set;
+}
+
+std::unique_ptr<Emitter> Build(const Case& c, size_t capacity, ThreadPool& pool) {
+    EmitterConfig cfg = BaseConfig(capacity);
+    c.configure(cfg);
+    auto e = std::make_unique<Emitter>(cfg);
+    e->SetThreadPool(&pool);
+    if (c.colliders) {
+        e->SetColliders(&Colliders());
+    }
+    if (c.affectors) {
+        e->AddAffector(Drag{ 0.3f });
+        e->AddAffector(Turbulence{ 0.5f, 0.8f });
+    }
+    return e;
+}
+
+// Fastest run of `run`, in ns per particle. `prepare` runs untimed before each run and returns the
+// particle count the run handles.
+template <class Prepare, class Run>
+double Measure(Prepare&& prepare, Run&& run) {
+    double best = std::numeric_limits<double>::infinity();
+    double total = 0.0;
+    for (int runs = 0; runs < minRuns || total < minSeconds; ++runs) {
+        size_t n = prepare();
+        auto start = Clock::now();
+        run();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        total += seconds;
+        if (n > 0) {
+            best = std::min(best, seconds * 1e9 / static_cast<double>(n));
+        }
+    }
+    return best;
+}
+
+struct Result {
+    std::string stage, name;
+    size_t particles, emitters;
+    double nsPerParticle;
+};
+
+void SweepEmitter(const Case& c, size_t count, ThreadPool& pool, const Matrix& view, std::vector<Result>& out) {
+    auto e = Build(c, count, pool);
+    e->Start();
+    e->Prewarm(2.0f, 0.25f);
+    for (int f = 0; f < 30; ++f) {
+        e->Update(frameTime);
+    }
+    size_t live = e->Particles().Size();
+    double update = Measure([&] { return e->Particles().Size(); }, [&] { e->Update(frameTime); });
+    out.push_back({ "update", c.name, live, 1, update });
+
+    std::unique_ptr<Emitter> empty;
+    double spawn = Measure([&] {
+        empty.reset();
+        empty = Build(c, count, pool);
+        return count;
+    }, [&] { empty->Spawn(count); });
+    out.push_back({ "spawn", c.name, count, 1, spawn });
+    empty.reset();
+
+    if (c.drawStages) {
+        DepthSorter sorter;
+        double sort = Measure([&] { return live; }, [&] { sorter.Sort(e->Particles(), view, nullptr, live); });
+        out.push_back({ "sort", c.name, live, 1, sort });
+
+        InstanceBatch batch;
+        batch.Reserve(count);
+        double build = Measure([&] {
+            batch.Clear();
+            return live;
+        }, [&] { e->AppendInstances(view, batch); });
+        out.push_back({ "build", c.name, live, 1, build });
+    }
+}
+
+void SweepSystem(size_t count, size_t emitterCount, ThreadPool& pool, std::vector<Result>& out) {
+    ParticleSystem system(pool);
+    for (size_t i = 0; i < emitterCount; ++i) {
+        EmitterConfig cfg = BaseConfig(count / emitterCount);
+        cfg.seed = i + 1;
+        cfg.origin = { static_cast<float>(i % 16) * 4.0f, 0.0f, static_cast<float>(i / 16) * 4.0f };
+        system.Emplace(cfg);
+    }
+    system.Start();
+    system.Prewarm(2.0f, 0.25f);
+    unsigned long live = 0;
+    for (int f = 0; f < 30; ++f) {
+        live = system.Update(frameTime);
+    }
+    double update = Measure([&] { return static_cast<size_t>(live); }, [&] { live = system.Update(frameTime); });
+    out.push_back({ "system", "default", live, emitterCount, update });
+}
+
+void WriteJson(std::ostream& os, const std::vector<Result>& results, size_t threads) {
+    os << std::boolalpha << "{\n  \"version\": 1,\n  \"simd\": \"" << SimdName() << "\",\n  \"f16c\": " << HasF16c()
+       << ",\n  \"fma\": " << HasFma() << ",\n  \"threads\": " << threads << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        os << "    { \"stage\": \"" << r.stage << "\", \"case\": \"" << r.name << "\", \"particles\": " << r.particles
+           << ", \"emitters\": " << r.emitters << ", \"ns_per_particle\": " << r.nsPerParticle << " }"
+           << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "  ]\n}\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t maxParticles = 10000000;
+    std::string outPath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--max" && i + 1 < argc) {
+            maxParticles = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--out" && i + 1 < argc) {
+            outPath = argv[++i];
+        }
+        else {
+            std::cerr << "usage: Benchmark [--max particles] [--out results.json]\n";
+            return 2;
+        }
+    }
+
+    ThreadPool& pool = ThreadPool::Default();
+    Matrix view = MatrixLookAt({ 5.0f, 5.0f, 10.0f }, { 0.0f, 2.0f, 0.0f }, { 0.0f, 1.0f, 0.0f });
+    std::vector<Result> results;
+    for (size_t count = 1000; count <= maxParticles; count *= 10) {
+        for (const Case& c : Cases()) {
+            if (count <= c.maxParticles) {
+                SweepEmitter(c, count, pool, view, results);
+            }
+        }
+        for (size_t emitters : { 1, 16, 256 }) {
+            if (count / emitters >= 100) {
+                SweepSystem(count, emitters, pool, results);
+            }
+        }
+        std::cerr << "done " << count << " particles\n";
+    }
+
+    if (outPath.empty()) {
+        WriteJson(std::cout, results, pool.Concurrency());
+        return 0;
+    }
+    std::ofstream file(outPath);
+    WriteJson(file, results, pool.Concurrency());
+    return file ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+// Bakes a text effect description into the binary file read by ParticleSystem::LoadEffect.
+//
+//   EffectBake fire.txt fire.rp3e            bake once
+//   EffectBake --watch fire.txt fire.rp3e    bake again whenever the text changes, the game picks
+//                                            the new file up with ParticleSystem::ReloadEffects
+//
+// One [emitter] section per emitter, then `key = value` lines named after the EmitterConfig members.
+// Vectors, ranges and colors are lists of numbers, enums are written as in C++ and `gradient` adds one
+// stop per line. `model` and `texture` name the files handed to the effect's resolver. Lines starting
+// with # are comments.
+//
+//   [emitter]
+//   velocity = 1 2
+//   age = 0.5 1.5
+//   capacity = 500
+//   emissionRate = 200
+//   blendMode = BLEND_ADDITIVE
+//   gradient = 0 255 150 0 255
+//   gradient = 1 255 50 0 0
+//   texture = textures/flame.png
+//   modelSize = 0.2
+//   interaction.model = Fluid
+
+#include "RayParticle3D.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+using Source = EffectFile::Source;
+using Setter = std::function<bool(std::istream&, Source&)>;
+
+template <class T>
+bool Read(std::istream& in, T& value) {
+    // istream wraps a negative number around for unsigned types instead of failing
+    if constexpr (std::is_unsigned_v<T>) {
+        if ((in >> std::ws).peek() == '-') return false;
+    }
+    return static_cast<bool>(in >> value);
+}
+
+// Sizes are 32 bits wide in the file and capacities must also pass EffectFile::Open
+bool Read(std::istream& in, size_t& value, size_t min, size_t max) {
+    return Read(in, value) && value >= min && value <= max;
+}
+
+bool Read(std::istream& in, Vector3& v) { return static_cast<bool>(in >> v.x >> v.y >> v.z); }
+bool Read(std::istream& in, FloatRange& r) { return static_cast<bool>(in >> r.min >> r.max); }
+bool Read(std::istream& in, IntRange& r) { return static_cast<bool>(in >> r.min >> r.max); }
+
+bool Read(std::istream& in, Color& c) {
+    int r, g, b, a;
+    if (!(in >> r >> g >> b >> a)) return false;
+    c = Color{ static_cast<unsigned char>(std::clamp(r, 0, 255)), static_cast<unsigned char>(std::clamp(g, 0, 255)),
+               static_cast<unsigned char>(std::clamp(b, 0, 255)), static_cast<unsigned char>(std::clamp(a, 0, 255)) };
+    return true;
+}
+
+bool Read(std::istream& in, bool& value) {
+    std::string word;
+    in >> word;
+    value = word == "true" || word == "1";
+    return value || word == "false" || word == "0";
+}
+
+// Enum written by name, `names` in the order of the enumerators
+template <class E>
+bool ReadEnum(std::istream& in, E& value, std::initializer_list<const char*> names) {
+    std::string word;
+    in >> word;
+    int index = 0;
+    for (const char* name : names) {
+        if (word == name) {
+            value = static_cast<E>(index);
+            return true;
+        }
+        ++index;
+    }
+    return false;
+}
+
+bool Read(std::istream& in, BlendMode& v) {
+    return ReadEnum(in, v, { "BLEND_ALPHA", "BLEND_ADDITIVE", "BLEND_MULTIPLIED", "BLEND_ADD_COLORS",
+                             "BLEND_SUBTRACT_COLORS", "BLEND_ALPHA_PREMULTIPLY", "BLEND_CUSTOM", "BLEND_CUSTOM_SEPARATE" });
+}
+bool Read(std::istream& in, DrawMode& v) { return ReadEnum(in, v, { "Model", "Instanced", "Billboard" }); }
+bool Read(std::istream& in, ParticleLayout& v) { return ReadEnum(in, v, { "Full", "Compact" }); }
+bool Read(std::istream& in, UpdateMode& v) { return ReadEnum(in, v, { "Serial", "Parallel" }); }
+bool Read(std::istream& in, SimulationBackend& v) { return ReadEnum(in, v, { "CPU", "GPU" }); }
+bool Read(std::istream& in, InteractionModel& v) { return ReadEnum(in, v, { "None", "Fluid", "Flock" }); }
+bool Read(std::istream& in, OverflowPolicy& v) { return ReadEnum(in, v, { "DropNew", "KillOldest", "Grow", "Defer" }); }
+
+template <class T>
+Setter Member(T EmitterConfig::* member) {
+    return [member](std::istream& in, Source& s) { return Read(in, s.config.*member); };
+}
+
+template <class T>
+Setter Interaction(T InteractionConfig::* member) {
+    return [member](std::istream& in, Source& s) { return Read(in, s.config.interaction.*member); };
+}
+
+template <class T>
+Setter Overflow(T OverflowConfig::* member) {
+    return [member](std::istream& in, Source& s) { return Read(in, s.config.overflow.*member); };
+}
+
+Setter Count(size_t EmitterConfig::* member, size_t min, size_t max) {
+    return [=](std::istream& in, Source& s) { return Read(in, s.config.*member, min, max); };
+}
+
+Setter OverflowCount(size_t OverflowConfig::* member, size_t min, size_t max) {
+    return [=](std::istream& in, Source& s) { return Read(in, s.config.overflow.*member, min, max); };
+}
+
+const std::unordered_map<std::string, Setter>& Fields() {
+    static const std::unordered_map<std::string, Setter> fields = {
+        { "direction", Member(&EmitterConfig::direction) },
+        { "velocity", Member(&EmitterConfig::velocity) },
+        { "directionAngle", Member(&EmitterConfig::directionAngle) },
+        { "velocityAngle", Member(&EmitterConfig::velocityAngle) },
+        { "offset", Member(&EmitterConfig::offset) },
+        { "originAcceleration", Member(&EmitterConfig::originAcceleration) },
+        { "age", Member(&EmitterConfig::age) },
+        { "burst", Member(&EmitterConfig::burst) },
+        { "capacity", Count(&EmitterConfig::capacity, 1, EffectFile::maxParticles) },
+        { "emissionRate", Count(&EmitterConfig::emissionRate, 0, UINT32_MAX) },
+        { "duration", Member(&EmitterConfig::duration) },
+        { "origin", Member(&EmitterConfig::origin) },
+        { "externalAcceleration", Member(&EmitterConfig::externalAcceleration) },
+        { "startColor", Member(&EmitterConfig::startColor) },
+        { "endColor", Member(&EmitterConfig::endColor) },
+        { "blendMode", Member(&EmitterConfig::blendMode) },
+        { "gravity", Member(&EmitterConfig::gravity) },
+        { "collision", Member(&EmitterConfig::collision) },
+        { "scaleByDistance", Member(&EmitterConfig::scaleByDistance) },
+        { "seed", Member(&EmitterConfig::seed) },
+        { "drawMode", Member(&EmitterConfig::drawMode) },
+        { "layout", Member(&EmitterConfig::layout) },
+        { "updateMode", Member(&EmitterConfig::updateMode) },
+        { "backend", Member(&EmitterConfig::backend) },
+        { "billboardSize", Member(&EmitterConfig::billboardSize) },
+        { "depthSort", Member(&EmitterConfig::depthSort) },
+        { "cullParticles", Member(&EmitterConfig::cullParticles) },
+        { "drawDistance", Member(&EmitterConfig::drawDistance) },
+        { "gradient", [](std::istream& in, Source& s) {
+            ColorStop stop;
+            if (!(in >> stop.position) || !Read(in, stop.color)) return false;
+            s.config.gradient.push_back(stop);
+            return true;
+        } },
+        { "model", [](std::istream& in, Source& s) { return static_cast<bool>(std::getline(in >> std::ws, s.model)); } },
+        { "texture", [](std::istream& in, Source& s) { return static_cast<bool>(std::getline(in >> std::ws, s.texture)); } },
+        { "modelSize", [](std::istream& in, Source& s) { return Read(in, s.modelSize); } },
+        { "interaction.model", Interaction(&InteractionConfig::model) },
+        { "interaction.radius", Interaction(&InteractionConfig::radius) },
+        { "interaction.restDensity", Interaction(&InteractionConfig::restDensity) },
+        { "interaction.stiffness", Interaction(&InteractionConfig::stiffness) },
+        { "interaction.viscosity", Interaction(&InteractionConfig::viscosity) },
+        { "interaction.separation", Interaction(&InteractionConfig::separation) },
+        { "interaction.cohesion", Interaction(&InteractionConfig::cohesion) },
+        { "interaction.alignment", Interaction(&InteractionConfig::alignment) },
+        { "overflow.policy", Overflow(&OverflowConfig::policy) },
+        { "overflow.maxCapacity", OverflowCount(&OverflowConfig::maxCapacity, 0, EffectFile::maxParticles) },
+        { "overflow.page", OverflowCount(&OverflowConfig::page, 0, UINT32_MAX) },
+        { "overflow.shrinkDelay", Overflow(&OverflowConfig::shrinkDelay) },
+    };
+    return fields;
+}
+
+std::string Trim(const std::string& s) {
+    size_t first = s.find_first_not_of(" \t\r");
+    if (first == std::string::npos) return {};
+    return s.substr(first, s.find_last_not_of(" \t\r") - first + 1);
+}
+
+// Reports the first error as `file:line: message` and returns false
+bool Parse(const std::string& path, std::vector<Source>& emitters) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << path << ": cannot open\n";
+        return false;
+    }
+    std::string text;
+    for (int line = 1; std::getline(in, text); ++line) {
+        text = Trim(text);
+        if (text.empty() || text[0] == '#') continue;
+        if (text == "[emitter]") {
+            emitters.emplace_back();
+            continue;
+        }
+        size_t equals = text.find('=');
+        std::string key = equals == std::string::npos ? text : Trim(text.substr(0, equals));
+        auto field = Fields().find(key);
+        if (emitters.empty() || equals == std::string::npos || field == Fields().end()) {
+            std::cerr << path << ":" << line << ": " << (emitters.empty() ? "expected [emitter]" : "unknown key " + key) << "\n";
+            return false;
+        }
+        std::istringstream value(text.substr(equals + 1));
+        if (!field->second(value, emitters.back()) || !(value >> std::ws).eof()) {
+            std::cerr << path << ":" << line << ": bad value for " << key << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Bake(const std::string& input, const std::string& output) {
+    std::vector<Source> emitters;
+    if (!Parse(input, emitters)) return false;
+    if (!EffectFile::Write(output, emitters)) {
+        std::cerr << output << ": cannot write\n";
+        return false;
+    }
+    std::cout << input << " -> " << output << ", " << emitters.size() << " emitters\n";
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    bool watch = argc == 4 && std::string(argv[1]) == "--watch";
+    if (argc != 3 && !watch) {
+        std::cerr << "usage: EffectBake [--watch] <input.txt> <output.rp3e>\n";
+        return 2;
+    }
+    std::string input = argv[argc - 2], output = argv[argc - 1];
+    if (!watch) {
+        return Bake(input, output) ? 0 : 1;
+    }
+
+    // Polls the text file, a failed bake leaves the last good output in place
+    std::filesystem::file_time_type baked{};
+    for (;;) {
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(input, ec);
+        if (!ec && time != baked) {
+            baked = time;
+            Bake(input, output);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    }
+}
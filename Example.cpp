@@ -1,5 +1,5 @@
 #include "raylib.h"
-#include "ParticleSystem.h"
+#include "RayParticle3D.h"
 
 int main() {
     // Initialization
@@ -12,7 +12,7 @@ int main() {
     camera.target = (Vector3){ 0.0f, 2.0f, 0.0f };
     camera.up = (Vector3){ 0.0f, 1.0f, 0.0f };
     camera.fovy = 45.0f;
-    camera.type = CAMERA_PERSPECTIVE;
+    camera.projection = CAMERA_PERSPECTIVE;
 
     // Load models to be used as particles
     Model fireModel = LoadModelFromMesh(GenMeshPlane(0.2f, 0.2f, 1, 1));
@@ -1,19 +1,607 @@
 #pragma once
 #include "raylib.h"
 #include "raymath.h"
+#include "rlgl.h"
 #include <vector>
 #include <memory>
 #include <algorithm>
-#include <execution>
 #include <optional>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <unordered_map>
+#include <functional>
+#include <tuple>
+#include <memory_resource>
+#include <chrono>
+#include <span>
+#include <cstdio>
+#include <filesystem>
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#elif defined(_WIN64)
+// Declared by hand because windows.h clashes with raylib names (CloseWindow, DrawText, Rectangle...)
+extern "C" __declspec(dllimport) unsigned __int64 __stdcall SetThreadAffinityMask(void* thread, unsigned __int64 mask);
+extern "C" __declspec(dllimport) void* __stdcall VirtualAlloc(void* address, unsigned __int64 size, unsigned long type, unsigned long protect);
+extern "C" __declspec(dllimport) int __stdcall VirtualFree(void* address, unsigned __int64 size, unsigned long type);
+extern "C" __declspec(dllimport) void* __stdcall wglGetProcAddress(const char* name);
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if !defined(RP3D_NO_SIMD) && defined(__AVX2__)
+#define RP3D_SIMD_AVX2 1
+#include <immintrin.h>
+#elif !defined(RP3D_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define RP3D_SIMD_SSE 1
+#include <emmintrin.h>
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+#elif !defined(RP3D_NO_SIMD) && defined(__ARM_NEON) && defined(__aarch64__)
+#define RP3D_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+#if !defined(RP3D_NO_SIMD) && defined(__F16C__) && !defined(RP3D_SIMD_AVX2)
+#include <immintrin.h>
+#endif
+
+// Profiler zones around the update and draw stages. Define RP3D_TRACY to emit Tracy zones, or
+// RP3D_CHROME_TRACE to record them with ChromeTrace. They compile to nothing otherwise.
+#if defined(RP3D_TRACY)
+#include <tracy/Tracy.hpp>
+#define RP3D_ZONE(name) ZoneScopedN(name)
+#elif defined(RP3D_CHROME_TRACE)
+#define RP3D_ZONE_JOIN(a, b) a##b
+#define RP3D_ZONE_VAR(line) RP3D_ZONE_JOIN(rp3dZone, line)
+#define RP3D_ZONE(name) ChromeTrace::Zone RP3D_ZONE_VAR(__LINE__)(name)
+#else
+#define RP3D_ZONE(name)
+#endif
+
+// Thin SIMD wrappers so particle kernels are written once and instantiated per lane type.
+// Define RP3D_NO_SIMD to force the scalar path.
+namespace rp3d::simd {
+
+// Single lane, used for the tail of every kernel and as the portable fallback
+struct Scalar {
+    static constexpr size_t width = 1;
+    float v;
+
+    static Scalar Load(const float* p) { return { *p }; }
+    static Scalar Set(float x) { return { x }; }
+    void Store(float* p) const { *p = v; }
+    // 16-bit unsigned integers widened to float, stored back rounded and saturated
+    static Scalar LoadU16(const uint16_t* p) { return { static_cast<float>(*p) }; }
+    void StoreU16(uint16_t* p) const { *p = static_cast<uint16_t>(std::clamp(v, 0.0f, 65535.0f) + 0.5f); }
+    // Loads p[index] for each lane, the indices are whole numbers held as floats
+    static Scalar Gather(const float* p, Scalar index) { return { p[static_cast<int>(index.v)] }; }
+};
+
+struct ScalarMask {
+    bool v;
+};
+
+inline Scalar operator+(Scalar a, Scalar b) { return { a.v + b.v }; }
+inline Scalar operator-(Scalar a, Scalar b) { return { a.v - b.v }; }
+inline Scalar operator*(Scalar a, Scalar b) { return { a.v * b.v }; }
+inline Scalar operator/(Scalar a, Scalar b) { return { a.v / b.v }; }
+inline Scalar MulAdd(Scalar a, Scalar b, Scalar c) { return { a.v * b.v + c.v }; }
+inline Scalar Sqrt(Scalar a) { return { sqrtf(a.v) }; }
+inline Scalar RSqrtEstimate(Scalar a) { return { 1.0f / sqrtf(a.v) }; }
+inline Scalar Min(Scalar a, Scalar b) { return { a.v < b.v ? a.v : b.v }; }
+inline Scalar Max(Scalar a, Scalar b) { return { a.v > b.v ? a.v : b.v }; }
+inline Scalar Round(Scalar a) { return { std::nearbyint(a.v) }; }
+inline ScalarMask operator<=(Scalar a, Scalar b) { return { a.v <= b.v }; }
+inline ScalarMask operator>(Scalar a, Scalar b) { return { a.v > b.v }; }
+inline ScalarMask operator&(ScalarMask a, ScalarMask b) { return { a.v && b.v }; }
+inline ScalarMask MaskSet(Scalar, bool b) { return { b }; }
+inline Scalar Select(ScalarMask m, Scalar a, Scalar b) { return { m.v ? a.v : b.v }; }
+inline size_t Count(ScalarMask m) { return m.v ? 1 : 0; }
+inline unsigned Bits(ScalarMask m) { return m.v ? 1u : 0u; }
+
+#if defined(RP3D_SIMD_AVX2)
+struct Float8 {
+    static constexpr size_t width = 8;
+    __m256 v;
+
+    static Float8 Load(const float* p) { return { _mm256_loadu_ps(p) }; }
+    static Float8 Set(float x) { return { _mm256_set1_ps(x) }; }
+    void Store(float* p) const { _mm256_storeu_ps(p, v); }
+    static Float8 LoadU16(const uint16_t* p) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        return { _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(h)) };
+    }
+    void StoreU16(uint16_t* p) const {
+        __m256i i = _mm256_cvtps_epi32(v);
+        __m128i h = _mm_packus_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), h);
+    }
+    static Float8 Gather(const float* p, Float8 index) {
+        return { _mm256_i32gather_ps(p, _mm256_cvttps_epi32(index.v), 4) };
+    }
+};
+
+struct Mask8 {
+    __m256 v;
+};
+
+inline Float8 operator+(Float8 a, Float8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+inline Float8 operator-(Float8 a, Float8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+inline Float8 operator*(Float8 a, Float8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+inline Float8 operator/(Float8 a, Float8 b) { return { _mm256_div_ps(a.v, b.v) }; }
+#if defined(__FMA__)
+inline Float8 MulAdd(Float8 a, Float8 b, Float8 c) { return { _mm256_fmadd_ps(a.v, b.v, c.v) }; }
+#else
+inline Float8 MulAdd(Float8 a, Float8 b, Float8 c) { return { _mm256_add_ps(_mm256_mul_ps(a.v, b.v), c.v) }; }
+#endif
+inline Float8 Sqrt(Float8 a) { return { _mm256_sqrt_ps(a.v) }; }
+inline Float8 RSqrtEstimate(Float8 a) { return { _mm256_rsqrt_ps(a.v) }; }
+inline Float8 Min(Float8 a, Float8 b) { return { _mm256_min_ps(a.v, b.v) }; }
+inline Float8 Max(Float8 a, Float8 b) { return { _mm256_max_ps(a.v, b.v) }; }
+inline Float8 Round(Float8 a) { return { _mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC) }; }
+inline Mask8 operator<=(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+inline Mask8 operator>(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+inline Mask8 operator&(Mask8 a, Mask8 b) { return { _mm256_and_ps(a.v, b.v) }; }
+inline Mask8 MaskSet(Float8, bool b) { return { _mm256_castsi256_ps(_mm256_set1_epi32(b ? -1 : 0)) }; }
+inline Float8 Select(Mask8 m, Float8 a, Float8 b) { return { _mm256_blendv_ps(b.v, a.v, m.v) }; }
+inline size_t Count(Mask8 m) { return std::popcount(static_cast<unsigned>(_mm256_movemask_ps(m.v))); }
+inline unsigned Bits(Mask8 m) { return static_cast<unsigned>(_mm256_movemask_ps(m.v)); }
+
+using Native = Float8;
+#elif defined(RP3D_SIMD_SSE)
+struct Float4 {
+    static constexpr size_t width = 4;
+    __m128 v;
+
+    static Float4 Load(const float* p) { return { _mm_loadu_ps(p) }; }
+    static Float4 Set(float x) { return { _mm_set1_ps(x) }; }
+    void Store(float* p) const { _mm_storeu_ps(p, v); }
+    static Float4 LoadU16(const uint16_t* p) {
+        __m128i h = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+        return { _mm_cvtepi32_ps(_mm_unpacklo_epi16(h, _mm_setzero_si128())) };
+    }
+    // SSE2 only packs with signed saturation, so the range is shifted by 32768 around the pack
+    void StoreU16(uint16_t* p) const {
+        __m128i i = _mm_sub_epi32(_mm_cvtps_epi32(v), _mm_set1_epi32(32768));
+        __m128i h = _mm_xor_si128(_mm_packs_epi32(i, i), _mm_set1_epi16(static_cast<short>(0x8000)));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p), h);
+    }
+    static Float4 Gather(const float* p, Float4 index) {
+        alignas(16) int32_t i[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(i), _mm_cvttps_epi32(index.v));
+        return { _mm_setr_ps(p[i[0]], p[i[1]], p[i[2]], p[i[3]]) };
+    }
+};
+
+struct Mask4 {
+    __m128 v;
+};
+
+inline Float4 operator+(Float4 a, Float4 b) { return { _mm_add_ps(a.v, b.v) }; }
+inline Float4 operator-(Float4 a, Float4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline Float4 operator*(Float4 a, Float4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+inline Float4 operator/(Float4 a, Float4 b) { return { _mm_div_ps(a.v, b.v) }; }
+inline Float4 MulAdd(Float4 a, Float4 b, Float4 c) { return { _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v) }; }
+inline Float4 Sqrt(Float4 a) { return { _mm_sqrt_ps(a.v) }; }
+inline Float4 RSqrtEstimate(Float4 a) { return { _mm_rsqrt_ps(a.v) }; }
+inline Float4 Min(Float4 a, Float4 b) { return { _mm_min_ps(a.v, b.v) }; }
+inline Float4 Max(Float4 a, Float4 b) { return { _mm_max_ps(a.v, b.v) }; }
+#if defined(__SSE4_1__)
+inline Float4 Round(Float4 a) { return { _mm_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC) }; }
+#else
+inline Float4 Round(Float4 a) { return { _mm_cvtepi32_ps(_mm_cvtps_epi32(a.v)) }; }
+#endif
+inline Mask4 operator<=(Float4 a, Float4 b) { return { _mm_cmple_ps(a.v, b.v) }; }
+inline Mask4 operator>(Float4 a, Float4 b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+inline Mask4 operator&(Mask4 a, Mask4 b) { return { _mm_and_ps(a.v, b.v) }; }
+inline Mask4 MaskSet(Float4, bool b) { return { _mm_castsi128_ps(_mm_set1_epi32(b ? -1 : 0)) }; }
+#if defined(__SSE4_1__)
+inline Float4 Select(Mask4 m, Float4 a, Float4 b) { return { _mm_blendv_ps(b.v, a.v, m.v) }; }
+#else
+inline Float4 Select(Mask4 m, Float4 a, Float4 b) { return { _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)) }; }
+#endif
+inline size_t Count(Mask4 m) { return std::popcount(static_cast<unsigned>(_mm_movemask_ps(m.v))); }
+inline unsigned Bits(Mask4 m) { return static_cast<unsigned>(_mm_movemask_ps(m.v)); }
+
+using Native = Float4;
+#elif defined(RP3D_SIMD_NEON)
+struct Float4 {
+    static constexpr size_t width = 4;
+    float32x4_t v;
+
+    static Float4 Load(const float* p) { return { vld1q_f32(p) }; }
+    static Float4 Set(float x) { return { vdupq_n_f32(x) }; }
+    void Store(float* p) const { vst1q_f32(p, v); }
+    static Float4 LoadU16(const uint16_t* p) { return { vcvtq_f32_u32(vmovl_u16(vld1_u16(p))) }; }
+    void StoreU16(uint16_t* p) const { vst1_u16(p, vqmovn_u32(vcvtnq_u32_f32(v))); }
+    static Float4 Gather(const float* p, Float4 index) {
+        int32_t i[4];
+        vst1q_s32(i, vcvtq_s32_f32(index.v));
+        float g[4] = { p[i[0]], p[i[1]], p[i[2]], p[i[3]] };
+        return { vld1q_f32(g) };
+    }
+};
+
+struct Mask4 {
+    uint32x4_t v;
+};
+
+inline Float4 operator+(Float4 a, Float4 b) { return { vaddq_f32(a.v, b.v) }; }
+inline Float4 operator-(Float4 a, Float4 b) { return { vsubq_f32(a.v, b.v) }; }
+inline Float4 operator*(Float4 a, Float4 b) { return { vmulq_f32(a.v, b.v) }; }
+inline Float4 operator/(Float4 a, Float4 b) { return { vdivq_f32(a.v, b.v) }; }
+inline Float4 MulAdd(Float4 a, Float4 b, Float4 c) { return { vfmaq_f32(c.v, a.v, b.v) }; }
+inline Float4 Sqrt(Float4 a) { return { vsqrtq_f32(a.v) }; }
+inline Float4 RSqrtEstimate(Float4 a) { return { vrsqrteq_f32(a.v) }; }
+inline Float4 Min(Float4 a, Float4 b) { return { vminq_f32(a.v, b.v) }; }
+inline Float4 Max(Float4 a, Float4 b) { return { vmaxq_f32(a.v, b.v) }; }
+inline Float4 Round(Float4 a) { return { vrndnq_f32(a.v) }; }
+inline Mask4 operator<=(Float4 a, Float4 b) { return { vcleq_f32(a.v, b.v) }; }
+inline Mask4 operator>(Float4 a, Float4 b) { return { vcgtq_f32(a.v, b.v) }; }
+inline Mask4 operator&(Mask4 a, Mask4 b) { return { vandq_u32(a.v, b.v) }; }
+inline Mask4 MaskSet(Float4, bool b) { return { vdupq_n_u32(b ? 0xFFFFFFFFu : 0u) }; }
+inline Float4 Select(Mask4 m, Float4 a, Float4 b) { return { vbslq_f32(m.v, a.v, b.v) }; }
+inline size_t Count(Mask4 m) { return vaddvq_u32(vshrq_n_u32(m.v, 31)); }
+inline unsigned Bits(Mask4 m) {
+    static const uint32x4_t weights = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(m.v, weights));
+}
+
+using Native = Float4;
+#else
+using Native = Scalar;
+#endif
+
+// Largest integer not above x, for any lane type
+template <class F>
+inline F Floor(F x) {
+    F r = Round(x);
+    return Select(r > x, r - F::Set(1.0f), r);
+}
+
+// 1 / sqrt(x) to about 22 bits: the hardware estimate refined by one Newton step. Infinite or NaN at 0.
+template <class F>
+inline F RSqrt(F x) {
+    F y = RSqrtEstimate(x);
+    return y * MulAdd(x * F::Set(-0.5f), y * y, F::Set(1.5f));
+}
+
+// Horizontal reductions, once a loop is done with its lanes
+template <class F>
+inline float ReduceAdd(F x) {
+    alignas(64) float v[F::width];
+    x.Store(v);
+    float sum = 0.0f;
+    for (float f : v) {
+        sum += f;
+    }
+    return sum;
+}
+
+template <class F>
+inline float ReduceMin(F x) {
+    alignas(64) float v[F::width];
+    x.Store(v);
+    return *std::min_element(v, v + F::width);
+}
+
+template <class F>
+inline float ReduceMax(F x) {
+    alignas(64) float v[F::width];
+    x.Store(v);
+    return *std::max_element(v, v + F::width);
+}
+
+// Sine and cosine of x for any lane type. Reduces to [-pi, pi], folds into [-pi/2, pi/2] and
+// evaluates Taylor polynomials there. Absolute error stays below 2e-6 for |x| < 50.
+template <class F>
+inline void SinCos(F x, F& sin, F& cos) {
+    const F pi = F::Set(PI), halfPi = F::Set(PI * 0.5f), zero = F::Set(0.0f);
+    F r = x - Round(x * F::Set(0.5f / PI)) * F::Set(2.0f * PI);
+
+    auto high = r > halfPi;
+    auto low = F::Set(-PI * 0.5f) > r;
+    r = Select(high, pi - r, Select(low, zero - pi - r, r));
+
+    F r2 = r * r;
+    F s = MulAdd(r2, F::Set(-1.0f / 39916800.0f), F::Set(1.0f / 362880.0f));
+    s = MulAdd(r2, s, F::Set(-1.0f / 5040.0f));
+    s = MulAdd(r2, s, F::Set(1.0f / 120.0f));
+    s = MulAdd(r2, s, F::Set(-1.0f / 6.0f));
+    sin = MulAdd(r2 * r, s, r);
+
+    F c = MulAdd(r2, F::Set(1.0f / 479001600.0f), F::Set(-1.0f / 3628800.0f));
+    c = MulAdd(r2, c, F::Set(1.0f / 40320.0f));
+    c = MulAdd(r2, c, F::Set(-1.0f / 720.0f));
+    c = MulAdd(r2, c, F::Set(1.0f / 24.0f));
+    c = MulAdd(r2, c, F::Set(-0.5f));
+    c = MulAdd(r2, c, F::Set(1.0f));
+    cos = Select(high, zero - c, Select(low, zero - c, c));
+}
+
+// IEEE half precision, rounded to nearest even. Bit-level versions of F16C's conversions.
+inline uint16_t FloatToHalf(float f) {
+    uint32_t x = std::bit_cast<uint32_t>(f);
+    uint16_t sign = static_cast<uint16_t>((x >> 16) & 0x8000);
+    x &= 0x7FFFFFFF;
+    if (x >= 0x47800000) {  // Beyond the half range, infinity or NaN
+        return sign | (x > 0x7F800000 ? 0x7E00 : 0x7C00);
+    }
+    if (x < 0x38800000) {  // Subnormal half: adding 0.5 lines the mantissa up for the FPU rounding
+        float shifted = std::bit_cast<float>(x) + 0.5f;
+        return sign | static_cast<uint16_t>(std::bit_cast<uint32_t>(shifted) - 0x3F000000);
+    }
+    uint32_t odd = (x >> 13) & 1;
+    x += 0xC8000FFF + odd;  // Rebias the exponent from 127 to 15 and round
+    return sign | static_cast<uint16_t>(x >> 13);
+}
+
+inline float HalfToFloat(uint16_t h) {
+    uint32_t x = (static_cast<uint32_t>(h) & 0x7FFF) << 13;
+    uint32_t exponent = x & 0x0F800000;
+    x += 0x38000000;  // Rebias the exponent from 15 to 127
+    if (exponent == 0x0F800000) {  // Infinity or NaN
+        x += 0x38000000;
+    }
+    else if (exponent == 0) {  // Subnormal, renormalized by the FPU
+        x = std::bit_cast<uint32_t>(std::bit_cast<float>(x + 0x00800000) - 6.103515625e-05f);
+    }
+    return std::bit_cast<float>(x | (static_cast<uint32_t>(h) & 0x8000) << 16);
+}
+
+inline void FloatToHalf(const float* src, uint16_t* dst, size_t n) {
+    size_t i = 0;
+#if !defined(RP3D_NO_SIMD) && defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+    }
+#elif defined(RP3D_SIMD_NEON)
+    for (; i + 4 <= n; i += 4) {
+        vst1_u16(dst + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src + i))));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = FloatToHalf(src[i]);
+    }
+}
+
+inline void HalfToFloat(const uint16_t* src, float* dst, size_t n) {
+    size_t i = 0;
+#if !defined(RP3D_NO_SIMD) && defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+    }
+#elif defined(RP3D_SIMD_NEON)
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src + i))));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = HalfToFloat(src[i]);
+    }
+}
+
+} // namespace rp3d::simd
+
+
+// Monotonic clock of the stats and trace zones, in nanoseconds
+inline uint64_t StatsClock() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Records the RP3D_ZONE markers as Chrome trace events, for chrome://tracing or Perfetto, when the
+// header is built with RP3D_CHROME_TRACE. Start, run some frames, Stop and Write. Each zone takes a
+// lock while recording, it is meant for profiling sessions.
+class ChromeTrace {
+public:
+    static ChromeTrace& Default() {
+        static ChromeTrace trace;
+        return trace;
+    }
+
+    void Start() {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.clear();
+        origin = StatsClock();
+        recording.store(true, std::memory_order_release);
+    }
+    void Stop() {
+        recording.store(false, std::memory_order_release);
+    }
+    bool IsRecording() const { return recording.load(std::memory_order_acquire); }
+
+    // JSON object format, one complete ("X") event per zone
+    bool Write(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::FILE* out = std::fopen(path.c_str(), "w");
+        if (!out) return false;
+        std::fputs("{\"traceEvents\":[\n", out);
+        for (size_t i = 0; i < events.size(); ++i) {
+            const Event& e = events[i];
+            std::fprintf(out, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+                         e.name, e.thread, (e.start - origin) * 1e-3, e.duration * 1e-3, i + 1 < events.size() ? "," : "");
+        }
+        std::fputs("]}\n", out);
+        return std::fclose(out) == 0;
+    }
+
+    // Scoped zone, `name` must be a string literal
+    class Zone {
+    public:
+        explicit Zone(const char* name) : name(name), start(StatsClock()) {}
+        ~Zone() {
+            ChromeTrace& trace = Default();
+            if (trace.IsRecording()) {
+                trace.Record(name, start, StatsClock() - start);
+            }
+        }
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+
+    private:
+        const char* name;
+        uint64_t start;
+    };
+
+private:
+    struct Event {
+        const char* name;
+        uint64_t start, duration;
+        unsigned thread;
+    };
+    std::atomic<bool> recording{ false };
+    std::mutex mutex;
+    std::vector<Event> events;
+    uint64_t origin = 0;
+
+    // Small thread ids, in the order threads first record
+    static unsigned ThreadId() {
+        static std::atomic<unsigned> next{ 0 };
+        thread_local unsigned id = next.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+
+    void Record(const char* name, uint64_t start, uint64_t duration) {
+        unsigned thread = ThreadId();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (start < origin) return;  // Opened before Start
+        events.push_back({ name, start, duration, thread });
+    }
+};
+
+// Fast xoshiro128+ generator. It runs 8 interleaved streams so refilling the output block vectorizes.
+// Not thread-safe: every emitter owns one, and ThreadLocal() serves code without an emitter.
+class RandomGenerator {
+public:
+    static constexpr size_t lanes = 8;
+
+    explicit RandomGenerator(uint64_t seed = 0x9E3779B97F4A7C15ull) {
+        Seed(seed);
+    }
+
+    // Same seed, same sequence, so effects can be replayed exactly
+    void Seed(uint64_t seed) {
+        for (size_t l = 0; l < lanes; ++l) {
+            uint64_t a = SplitMix64(seed), b = SplitMix64(seed);
+            s0[l] = static_cast<uint32_t>(a);
+            s1[l] = static_cast<uint32_t>(a >> 32);
+            s2[l] = static_cast<uint32_t>(b);
+            s3[l] = static_cast<uint32_t>(b >> 32) | 1u;  // Never all zero
+        }
+        cursor = lanes;
+    }
+
+    // Seed that differs for every call, for emitters that do not need to be reproducible
+    static uint64_t UniqueSeed() {
+        static std::atomic<uint64_t> counter{ (static_cast<uint64_t>(std::random_device{}()) << 32) ^ std::random_device{}() };
+        return counter.fetch_add(0x9E3779B97F4A7C15ull, std::memory_order_relaxed);
+    }
+
+    static RandomGenerator& ThreadLocal() {
+        thread_local RandomGenerator generator(UniqueSeed());
+        return generator;
+    }
+
+    uint32_t NextUInt() {
+        if (cursor == lanes) {
+            Step(block);
+            cursor = 0;
+        }
+        return block[cursor++];
+    }
+
+    // Uniform in [0, 1), built from the top 24 bits that xoshiro128+ gets right
+    float NextFloat() {
+        return ToFloat(NextUInt());
+    }
+
+    // Uniform in [min, max], multiply-shift instead of a modulo
+    int NextInt(int min, int max) {
+        uint64_t span = static_cast<uint64_t>(static_cast<int64_t>(max) - min) + 1;
+        return static_cast<int>(min + static_cast<int64_t>((NextUInt() * span) >> 32));
+    }
+
+    // Fills out[0, n) with the same values n NextFloat() calls would return, a whole block per step
+    void FillFloat(float* out, size_t n) {
+        size_t i = 0;
+        for (; i < n && cursor < lanes; ++i) {
+            out[i] = NextFloat();
+        }
+        alignas(32) uint32_t raw[lanes];
+        for (; i + lanes <= n; i += lanes) {
+            Step(raw);
+            for (size_t l = 0; l < lanes; ++l) {
+                out[i + l] = ToFloat(raw[l]);
+            }
+        }
+        for (; i < n; ++i) {
+            out[i] = NextFloat();
+        }
+    }
+
+private:
+    alignas(32) uint32_t s0[lanes], s1[lanes], s2[lanes], s3[lanes];
+    alignas(32) uint32_t block[lanes];
+    size_t cursor = lanes;
+
+    static float ToFloat(uint32_t x) {
+        return static_cast<float>(x >> 8) * (1.0f / 16777216.0f);
+    }
+
+    static uint64_t SplitMix64(uint64_t& x) {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // One xoshiro128+ step on every lane, written as a plain lane loop the compiler turns into SIMD
+    void Step(uint32_t* out) {
+        for (size_t l = 0; l < lanes; ++l) {
+            out[l] = s0[l] + s3[l];
+            uint32_t t = s1[l] << 9;
+            s2[l] ^= s0[l];
+            s3[l] ^= s1[l];
+            s1[l] ^= s2[l];
+            s0[l] ^= s3[l];
+            s2[l] ^= t;
+            s3[l] = (s3[l] << 11) | (s3[l] >> 21);
+        }
+    }
+};
 
 // Utility structure to represent a range of float values
 struct FloatRange {
     float min, max;
 
+    float RandomValue(RandomGenerator& rng) const {
+        return rng.NextFloat() * (max - min) + min;
+    }
+
     float RandomValue() const {
-        return ((float)GetRandomValue(0, RAND_MAX) / (float)RAND_MAX) * (max - min) + min;
+        return RandomValue(RandomGenerator::ThreadLocal());
     }
 };
 
@@ -21,243 +609,5198 @@ struct FloatRange {
 struct IntRange {
     int min, max;
 
-    int RandomValue() const {
-        return GetRandomValue(min, max);
+    int RandomValue(RandomGenerator& rng) const {
+        return min <= max ? rng.NextInt(min, max) : rng.NextInt(max, min);
+    }
+
+    int RandomValue() const {
+        return RandomValue(RandomGenerator::ThreadLocal());
+    }
+};
+
+// Threading used for the particles of a single emitter
+enum class UpdateMode {
+    Serial,    // Whole emitter updated on the calling thread
+    Parallel   // Live range split into cache-line aligned chunks across a ThreadPool
+};
+
+// Where an emitter's particles are simulated
+enum class SimulationBackend {
+    CPU,  // ParticleStore and SIMD kernels
+    GPU   // Compute shader, needs raylib built for OpenGL 4.3; falls back to CPU with a warning otherwise
+};
+
+// Rendering path used by an emitter
+enum class DrawMode {
+    Model,      // One DrawModel call per particle
+    Instanced,  // One DrawMeshInstanced call per emitter, colors sent as a per-instance attribute
+    Billboard   // Camera-facing textured quads, one draw call per emitter
+};
+
+// Per-particle storage layout
+enum class ParticleLayout {
+    Full,     // 52 bytes per particle, every field as a float
+    Compact   // 30 bytes: float positions, half precision velocity, spawn origin and constants, 16-bit life fraction
+};
+
+// Default shader for instanced particles (GLSL 330), reads the per-instance transform and color
+struct InstancingShader {
+    static constexpr int colorLocation = 11;
+    static constexpr int transformLocation = 12;  // mat4, occupies locations 12..15
+
+    static const Shader& Get() {
+        static Shader shader = Load();
+        return shader;
+    }
+
+private:
+    static Shader Load() {
+        static const char* vs = R"(#version 330
+in vec3 vertexPosition;
+in vec2 vertexTexCoord;
+layout(location = 11) in vec4 instanceColor;
+layout(location = 12) in mat4 instanceTransform;
+uniform mat4 mvp;
+out vec2 fragTexCoord;
+out vec4 fragColor;
+void main() {
+    fragTexCoord = vertexTexCoord;
+    fragColor = instanceColor;
+    gl_Position = mvp * instanceTransform * vec4(vertexPosition, 1.0);
+}
+)";
+        static const char* fs = R"(#version 330
+in vec2 fragTexCoord;
+in vec4 fragColor;
+uniform sampler2D texture0;
+uniform vec4 colDiffuse;
+out vec4 finalColor;
+void main() {
+    finalColor = texture(texture0, fragTexCoord) * colDiffuse * fragColor;
+}
+)";
+        Shader shader = LoadShaderFromMemory(vs, fs);
+        shader.locs[SHADER_LOC_MATRIX_MODEL] = transformLocation;
+        return shader;
+    }
+};
+
+// Color at a point of the particle lifetime, position in [0, 1]
+struct ColorStop {
+    float position;
+    Color color;
+};
+
+// Shared handle to a cached model, the model is unloaded when the last handle goes away
+using ModelHandle = std::shared_ptr<const Model>;
+using TextureHandle = std::shared_ptr<const Texture2D>;
+
+// Reference-counted particle models and textures, keyed by name or file path. The cache only keeps
+// weak references, so entries live as long as some emitter holds their handle. Emitters sharing a
+// handle share GPU buffers, and ParticleSystem batches their instanced draws.
+class ModelCache {
+public:
+    static ModelCache& Default() {
+        static ModelCache cache;
+        return cache;
+    }
+
+    // Model stored under `key`, `load` only runs when no handle to it is alive
+    template <class Loader>
+    ModelHandle Get(const std::string& key, Loader&& load) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ModelHandle model = models[key].lock()) return model;
+        return Insert(key, load(), nullptr);
+    }
+
+    TextureHandle Texture(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (TextureHandle texture = textures[path].lock()) return texture;
+        TextureHandle texture(new Texture2D(LoadTexture(path.c_str())), [](const Texture2D* t) {
+            UnloadTexture(*t);
+            delete t;
+        });
+        textures[path] = texture;
+        return texture;
+    }
+
+    // Model file at `path`, with the diffuse map of its first material replaced when `texturePath` is set
+    ModelHandle Load(const std::string& path, const std::string& texturePath = {}) {
+        if (texturePath.empty()) {
+            return Get(path, [&] { return LoadModel(path.c_str()); });
+        }
+        TextureHandle texture = Texture(texturePath);
+        std::string key = path + ":" + texturePath;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ModelHandle model = models[key].lock()) return model;
+        Model model = LoadModel(path.c_str());
+        model.materials[0].maps[MATERIAL_MAP_DIFFUSE].texture = *texture;
+        return Insert(key, model, std::move(texture));
+    }
+
+    // Square GenMeshPlane of edge `size` textured with the image at `texturePath`, the usual particle sprite
+    ModelHandle TexturedPlane(const std::string& texturePath, float size = 1.0f) {
+        TextureHandle texture = Texture(texturePath);
+        std::string key = "plane:" + std::to_string(size) + ":" + texturePath;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ModelHandle model = models[key].lock()) return model;
+        Model model = LoadModelFromMesh(GenMeshPlane(size, size, 1, 1));
+        model.materials[0].maps[MATERIAL_MAP_DIFFUSE].texture = *texture;
+        return Insert(key, model, std::move(texture));
+    }
+
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, std::weak_ptr<const Model>> models;
+    std::unordered_map<std::string, std::weak_ptr<const Texture2D>> textures;
+
+    // The texture handle is kept by the model's deleter, UnloadModel leaves textures alone. The deleter
+    // outlives the model while the cache holds a weak reference, so it drops the texture itself.
+    ModelHandle Insert(const std::string& key, Model model, TextureHandle texture) {
+        ModelHandle handle(new Model(model), [texture = std::move(texture)](const Model* m) mutable {
+            UnloadModel(*m);
+            delete m;
+            texture.reset();
+        });
+        models[key] = handle;
+        return handle;
+    }
+};
+
+// Forces between the particles of one emitter, evaluated by a NeighborGrid
+enum class InteractionModel {
+    None,   // Particles ignore each other
+    Fluid,  // SPH-style pressure: crowded particles push each other apart, like expanding smoke
+    Flock   // Separation, cohesion and alignment, for swarms and clustering embers
+};
+
+struct InteractionConfig {
+    InteractionModel model = InteractionModel::None;
+    float radius = 0.5f;  // Interaction range, also the edge of the grid cells
+    // Fluid: density counts the particles within `radius`, weighted by (1 - r^2 / radius^2)^3, self included
+    float restDensity = 4.0f;  // Density above which the pressure pushes out
+    float stiffness = 2.0f;  // Pressure per unit of density above the rest density
+    float viscosity = 0.0f;  // Pull of each particle's velocity toward its neighbors'
+    // Flock
+    float separation = 1.0f;  // Push away from neighbors, strongest at contact
+    float cohesion = 0.0f;  // Pull toward the neighbors' center
+    float alignment = 0.0f;  // Pull of the velocity toward the neighbors' mean
+};
+
+// What an emitter does with emission that finds every slot taken. Last in the list so effect files
+// keep their values, Defer is the default.
+enum class OverflowPolicy {
+    DropNew,     // The new particles are dropped
+    KillOldest,  // The particles furthest into their lifetime make room for the new ones
+    Grow,        // The capacity grows a page at a time up to maxCapacity, then new particles are dropped
+    Defer        // Steady emission waits until slots free up, bursts are dropped
+};
+
+struct OverflowConfig {
+    OverflowPolicy policy = OverflowPolicy::Defer;
+    size_t maxCapacity = 0;  // Grow: hard cap, `capacity` is where the emitter starts and shrinks back to
+    size_t page = 1024;  // Grow: particles added or given back at a time
+    float shrinkDelay = 0.0f;  // Grow: seconds with a page or more unused before it is given back, 0 never shrinks
+};
+
+// Configuration structure for particle emitters
+struct EmitterConfig {
+    Vector3 direction;
+    FloatRange velocity, directionAngle, velocityAngle, offset, originAcceleration, age;
+    IntRange burst;
+    size_t capacity, emissionRate;
+    float duration = 0.0f;  // Seconds of steady emission after Start, 0 emits until Stop
+    Vector3 origin, externalAcceleration;
+    Color startColor, endColor;  // Used when no gradient is given
+    BlendMode blendMode;
+    Model model;  // 3D model to be used for particles
+    float gravity;  // Gravity affecting the particles
+    bool collision;  // Enable collision detection
+    bool scaleByDistance = true;  // Shrink particles with their distance to the origin, CPU emitters only
+    uint64_t seed = 0;  // Seed for the emitter's random generator, 0 picks a distinct one per emitter
+    DrawMode drawMode = DrawMode::Model;  // How particles are submitted for rendering
+    ParticleLayout layout = ParticleLayout::Full;  // Compact halves the memory traffic of large CPU emitters
+    UpdateMode updateMode = UpdateMode::Serial;  // Whether a single emitter spreads its update over threads
+    SimulationBackend backend = SimulationBackend::CPU;  // GPU keeps all particle state in video memory
+    float billboardSize = 1.0f;  // Quad edge length for DrawMode::Billboard, multiplied by the particle scale
+    bool depthSort = false;  // Draw back to front, for BLEND_ALPHA emitters whose particles overlap
+    bool cullParticles = false;  // Skip drawing particles outside the view frustum, worth it for large effects
+    float drawDistance = 0.0f;  // ParticleSystem::Draw(camera) skips the emitter beyond it, 0 disables
+    ModelHandle sharedModel;  // Model from a ModelCache, replaces `model` and is kept alive by the emitter
+    std::vector<ColorStop> gradient;  // Multi-stop lifetime colors, replaces startColor/endColor when set
+    InteractionConfig interaction;  // Forces between neighboring particles, off by default, CPU emitters only
+    OverflowConfig overflow;  // What happens once `capacity` is reached, CPU emitters only
+};
+
+// Lifetime colors baked into a fixed lookup table when the emitter is built, so drawing a particle
+// costs one multiply and one load whatever the number of stops
+class ColorGradient {
+public:
+    static constexpr size_t size = 256;
+
+    explicit ColorGradient(const EmitterConfig& cfg) {
+        std::vector<ColorStop> stops = cfg.gradient;
+        if (stops.empty()) {
+            stops = { { 0.0f, cfg.startColor }, { 1.0f, cfg.endColor } };
+        }
+        std::stable_sort(stops.begin(), stops.end(), [](const ColorStop& a, const ColorStop& b) {
+            return a.position < b.position;
+        });
+
+        size_t next = 0;
+        for (size_t i = 0; i < size; ++i) {
+            float t = static_cast<float>(i) / (size - 1);
+            while (next < stops.size() && stops[next].position <= t) {
+                ++next;
+            }
+            if (next == 0) {
+                table[i] = stops.front().color;
+            }
+            else if (next == stops.size()) {
+                table[i] = stops.back().color;
+            }
+            else {
+                const ColorStop& a = stops[next - 1];
+                const ColorStop& b = stops[next];
+                table[i] = Lerp(a.color, b.color, (t - a.position) / (b.position - a.position));
+            }
+        }
+    }
+
+    // life = age / ttl, expected in [0, 1]
+    Color Sample(float life) const {
+        return table[static_cast<size_t>(std::min(life, 1.0f) * (size - 1) + 0.5f)];
+    }
+
+    const Color* Data() const { return table.data(); }
+
+private:
+    std::array<Color, size> table;
+
+    static Color Lerp(const Color& c1, const Color& c2, float fraction) {
+        return Color{
+            static_cast<unsigned char>((c2.r - c1.r) * fraction + c1.r),
+            static_cast<unsigned char>((c2.g - c1.g) * fraction + c1.g),
+            static_cast<unsigned char>((c2.b - c1.b) * fraction + c1.b),
+            static_cast<unsigned char>((c2.a - c1.a) * fraction + c1.a)
+        };
+    }
+};
+
+// Bump allocator over one contiguous block, for the particle storage of every emitter in a system.
+// Emitters built in sequence sit next to each other in memory, and a freed range is only reused
+// when the arena goes away. Once the block is full, requests go to the upstream resource. The block
+// is aligned to 2 MB and, on Linux, marked for transparent huge pages. Not thread safe.
+class ParticleArena : public std::pmr::memory_resource {
+public:
+    static constexpr size_t pageSize = size_t(2) << 20;
+
+    explicit ParticleArena(size_t bytes, std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+        : capacity((bytes + pageSize - 1) / pageSize * pageSize), upstream(upstream) {
+        block = static_cast<std::byte*>(::operator new(capacity, std::align_val_t{ pageSize }));
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        madvise(block, capacity, MADV_HUGEPAGE);
+#endif
+    }
+
+    ~ParticleArena() override {
+        ::operator delete(block, std::align_val_t{ pageSize });
+    }
+
+    ParticleArena(const ParticleArena&) = delete;
+    ParticleArena& operator=(const ParticleArena&) = delete;
+
+    size_t Capacity() const { return capacity; }
+    size_t Used() const { return used; }
+    size_t Overflow() const { return overflow; }  // Bytes that did not fit and came from upstream
+
+private:
+    std::byte* block;
+    size_t capacity, used = 0, overflow = 0;
+    std::pmr::memory_resource* upstream;
+
+    void* do_allocate(size_t bytes, size_t align) override {
+        size_t offset = (used + align - 1) / align * align;
+        if (offset + bytes <= capacity) {
+            used = offset + bytes;
+            return block + offset;
+        }
+        overflow += bytes;
+        return upstream->allocate(bytes, align);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t align) override {
+        auto* b = static_cast<std::byte*>(p);
+        if (b >= block && b < block + capacity) return;
+        overflow -= bytes;
+        upstream->deallocate(p, bytes, align);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// Address space for a ParticleStore that grows. The range is reserved at the store's largest size,
+// and its pages only take memory once committed and written, so the arrays never move. Decommit
+// gives whole pages back to the OS. Reserve returns null where this is not available.
+struct PageReservation {
+    static size_t PageBytes() {
+#if defined(__unix__) || defined(__APPLE__)
+        static const size_t bytes = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return bytes;
+#else
+        return 4096;
+#endif
+    }
+
+    static void* Reserve(size_t bytes) {
+#if defined(__unix__) || defined(__APPLE__)
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_NORESERVE)
+        flags |= MAP_NORESERVE;
+#endif
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+        return p == MAP_FAILED ? nullptr : p;
+#elif defined(_WIN64)
+        return VirtualAlloc(nullptr, bytes, memReserve, pageReadWrite);
+#else
+        (void)bytes;
+        return nullptr;
+#endif
+    }
+
+    static void Release(void* p, size_t bytes) {
+#if defined(__unix__) || defined(__APPLE__)
+        munmap(p, bytes);
+#elif defined(_WIN64)
+        (void)bytes;
+        VirtualFree(p, 0, memRelease);
+#else
+        (void)p;
+        (void)bytes;
+#endif
+    }
+
+    // Makes [p, p + bytes) writable. Anonymous mappings are backed on first write already.
+    static void Commit(void* p, size_t bytes) {
+#if defined(_WIN64)
+        if (bytes > 0) {
+            VirtualAlloc(p, bytes, memCommit, pageReadWrite);
+        }
+#else
+        (void)p;
+        (void)bytes;
+#endif
+    }
+
+    // Drops the pages lying entirely inside [p, p + bytes), they read as zero when committed again.
+    // The pages at the ends may hold another array's data and are kept.
+    static void Decommit(void* p, size_t bytes) {
+        uintptr_t page = PageBytes();
+        uintptr_t first = (reinterpret_cast<uintptr_t>(p) + page - 1) / page * page;
+        uintptr_t last = (reinterpret_cast<uintptr_t>(p) + bytes) / page * page;
+        if (last <= first) return;
+#if defined(__unix__) || defined(__APPLE__)
+        madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+#elif defined(_WIN64)
+        VirtualFree(reinterpret_cast<void*>(first), last - first, memDecommit);
+#endif
+    }
+
+private:
+#if defined(_WIN64)
+    static constexpr unsigned long memCommit = 0x1000, memReserve = 0x2000, memDecommit = 0x4000, memRelease = 0x8000;
+    static constexpr unsigned long pageReadWrite = 0x04;
+#endif
+};
+
+// Structure-of-arrays particle storage. Every array lives in one 64-byte aligned block, padded to a
+// whole cache line. Live particles are kept packed in [0, Size()), expired ones are swapped with the last.
+//
+// The compact layout keeps the positions as floats, so culling, sorting and drawing read them as is.
+// The spawn origin is stored as a half precision offset from the emitter origin, rebased by every
+// update the emitter moved in, and the distance scale is recomputed from the emitter origin. The
+// kernels run on blocks unpacked into a per-thread full-layout store, so memory traffic shrinks
+// while the math stays the same.
+class ParticleStore {
+public:
+    static constexpr size_t alignment = 64;
+    static constexpr size_t laneBlock = alignment / sizeof(float);
+    static constexpr size_t scratchSize = 256;  // Particles per unpacked block of a compact store
+
+    // Full layout, null in the compact one except for the positions
+    float *px = nullptr, *py = nullptr, *pz = nullptr;  // Position
+    float *vx = nullptr, *vy = nullptr, *vz = nullptr;  // Velocity
+    float *ox = nullptr, *oy = nullptr, *oz = nullptr;  // Origin captured at spawn, target of the origin attraction
+    float *originAcceleration = nullptr, *age = nullptr, *invTtl = nullptr, *scale = nullptr;  // invTtl = 1 / lifetime, so age * invTtl is the life fraction
+
+    // Compact layout, null in the full one
+    struct Packed {
+        uint16_t *vx, *vy, *vz;  // Half precision velocity
+        uint16_t *originAcceleration, *invTtl;  // Half precision, set at spawn
+        uint16_t *life;  // age * invTtl in steps of 1/65535
+        uint16_t *ox, *oy, *oz;  // Spawn origin minus offsetOrigin, half precision
+    } packed{};
+    Vector3 origin{};  // Compact layout: the emitter origin, kept up to date by the emitter
+    Vector3 offsetOrigin{};  // Compact layout: what packed.ox/oy/oz are relative to, `origin` as of the last update
+    bool scaleByDistance = true;  // Compact layout: false keeps every scale at 1
+
+    // Positions before the last update, null until EnableHistory. `alpha` blends them with the
+    // current positions in DrawPosition, 1 shows the current ones.
+    float *prevX = nullptr, *prevY = nullptr, *prevZ = nullptr;
+    float alpha = 1.0f;
+
+    // All arrays live in one block from `memory`, e.g. a ParticleArena shared by the whole system.
+    // A `maxCapacity` above `capacity` lets Reserve grow the store up to it. The block is then a
+    // PageReservation of the largest size, committed as the store grows, and `memory` is only used
+    // where reservations are not available.
+    explicit ParticleStore(size_t capacity, std::pmr::memory_resource* memory = std::pmr::get_default_resource(),
+                           ParticleLayout layout = ParticleLayout::Full, size_t maxCapacity = 0)
+        : capacity(capacity), maxCapacity(std::max(capacity, maxCapacity)),
+          stride((this->maxCapacity + laneBlock - 1) / laneBlock * laneBlock), memory(memory),
+          floats(layout == ParticleLayout::Full ? 13 : 3), halves(layout == ParticleLayout::Full ? 0 : 9) {
+        float** full[] = { &px, &py, &pz, &vx, &vy, &vz, &ox, &oy, &oz, &originAcceleration, &age, &invTtl, &scale };
+        uint16_t** compact[] = { &packed.vx, &packed.vy, &packed.vz, &packed.originAcceleration, &packed.invTtl, &packed.life,
+                                 &packed.ox, &packed.oy, &packed.oz };
+        Allocate(full, compact);
+    }
+
+    // Draw-only copy taken by Emitter::PublishSnapshot: position, scale and life, 18 bytes per particle
+    struct SnapshotLayout {};
+    ParticleStore(size_t capacity, std::pmr::memory_resource* memory, SnapshotLayout, size_t maxCapacity = 0)
+        : capacity(capacity), maxCapacity(std::max(capacity, maxCapacity)),
+          stride((this->maxCapacity + laneBlock - 1) / laneBlock * laneBlock), memory(memory), floats(4), halves(1) {
+        float** arrays[] = { &px, &py, &pz, &scale };
+        uint16_t** life[] = { &packed.life };
+        Allocate(arrays, life);
+    }
+
+    ~ParticleStore() {
+        DeallocateArrays(block, Bytes());
+        if (prevX) {
+            DeallocateArrays(prevX, stride * 3 * sizeof(float));
+        }
+    }
+
+    // Allocates the previous positions, which the update kernel fills from then on
+    void EnableHistory() {
+        if (prevX) return;
+        prevX = static_cast<float*>(AllocateArrays(stride * 3 * sizeof(float), alignment));
+        prevY = prevX + stride;
+        prevZ = prevY + stride;
+        if (paged) {
+            for (float* prev : { prevX, prevY, prevZ }) {
+                PageReservation::Commit(prev, capacity * sizeof(float));
+            }
+        }
+        std::copy_n(px, size, prevX);
+        std::copy_n(py, size, prevY);
+        std::copy_n(pz, size, prevZ);
+    }
+
+    ParticleStore(const ParticleStore&) = delete;
+    ParticleStore& operator=(const ParticleStore&) = delete;
+
+    size_t Capacity() const { return capacity; }
+    size_t MaxCapacity() const { return maxCapacity; }
+    size_t Size() const { return size; }
+    size_t Free() const { return capacity - size; }
+
+    // Raises the capacity to `count`, at most MaxCapacity. The arrays stay where they are, only the
+    // pages of the new slots are committed.
+    void Reserve(size_t count) {
+        count = std::min(count, maxCapacity);
+        if (count <= capacity) return;
+        if (paged) {
+            ForEachPagedArray([&](std::byte* array, size_t width) {
+                PageReservation::Commit(array + capacity * width, (count - capacity) * width);
+            });
+        }
+        capacity = count;
+    }
+
+    // Lowers the capacity to `count`, never below the live count, and gives the pages past it back
+    void Shrink(size_t count) {
+        count = std::max(count, size);
+        if (count >= capacity) return;
+        capacity = count;
+        if (paged) {
+            ForEachPagedArray([&](std::byte* array, size_t width) {
+                PageReservation::Decommit(array + capacity * width, (stride - capacity) * width);
+            });
+        }
+    }
+    bool IsCompact() const { return packed.vx != nullptr; }
+    size_t BytesPerParticle() const { return floats * sizeof(float) + halves * sizeof(uint16_t); }
+
+    bool IsExpired(size_t i) const {
+        return Life(i) > 1.0f;
+    }
+
+    // Fraction of the lifetime elapsed. The compact layout saturates at 1.
+    float Life(size_t i) const {
+        return packed.life ? packed.life[i] * (1.0f / 65535.0f) : age[i] * invTtl[i];
+    }
+
+    // Draw scale. Same falloff with the distance to the origin as ParticleKernel.
+    float Scale(size_t i) const {
+        if (scale) return scale[i];
+        if (!scaleByDistance) return 1.0f;
+        float dist = Vector3Distance(Position(i), origin);
+        return 1.0f / (dist * 0.1f + 1.0f);
+    }
+
+    // Appends `count` slots at the end of the live range and returns the first, the caller fills every field
+    size_t Push(size_t count) {
+        size_t first = size;
+        size += count;
+        return first;
+    }
+
+    void Clear() { size = 0; }
+
+    // Removes the particles at the given indices by moving live particles from the end of the range
+    // into the holes. Costs O(count) for ascending indices, as the update kernel lists them,
+    // independent of the live range size. Other lists are sorted in place and their repeats dropped.
+    void Remove(uint32_t* holes, size_t count) {
+        if (std::adjacent_find(holes, holes + count, std::greater_equal<uint32_t>()) != holes + count) {
+            std::sort(holes, holes + count);
+            count = static_cast<size_t>(std::unique(holes, holes + count) - holes);
+        }
+        size_t newSize = size - count;
+        size_t last = size;
+        size_t back = count;
+        for (size_t k = 0; k < count && holes[k] < newSize; ++k) {
+            --last;
+            while (back > 0 && holes[back - 1] == last) {
+                --back;
+                --last;
+            }
+            CopySlot(holes[k], last);
+        }
+        size = newSize;
+    }
+
+    Vector3 Position(size_t i) const {
+        return { px[i], py[i], pz[i] };
+    }
+
+    // Position to draw, between the previous and the current one when interpolating
+    Vector3 DrawPosition(size_t i) const {
+        if (!prevX || alpha >= 1.0f) return Position(i);
+        return { prevX[i] + (px[i] - prevX[i]) * alpha, prevY[i] + (py[i] - prevY[i]) * alpha,
+                 prevZ[i] + (pz[i] - prevZ[i]) * alpha };
+    }
+
+    // Compact layout: expands slots [begin, begin + n) into slots [0, n) of the full-layout `out`.
+    // Positions are not copied, the caller points `out` at them.
+    void Unpack(size_t begin, size_t n, ParticleStore& out) const {
+        using namespace rp3d::simd;
+        HalfToFloat(packed.vx + begin, out.vx, n);
+        HalfToFloat(packed.vy + begin, out.vy, n);
+        HalfToFloat(packed.vz + begin, out.vz, n);
+        HalfToFloat(packed.originAcceleration + begin, out.originAcceleration, n);
+        HalfToFloat(packed.invTtl + begin, out.invTtl, n);
+        const uint16_t* offsets[] = { packed.ox, packed.oy, packed.oz };
+        float* origins[] = { out.ox, out.oy, out.oz };
+        float base[] = { offsetOrigin.x, offsetOrigin.y, offsetOrigin.z };
+        for (int a = 0; a < 3; ++a) {
+            HalfToFloat(offsets[a] + begin, origins[a], n);
+            for (size_t j = 0; j < n; ++j) {
+                origins[a][j] += base[a];
+            }
+        }
+        size_t j = 0;
+        for (; j + Native::width <= n; j += Native::width) {
+            UnpackAge<Native>(begin + j, out, j);
+        }
+        for (; j < n; ++j) {
+            UnpackAge<Scalar>(begin + j, out, j);
+        }
+    }
+
+    // Compact layout: packs slots [0, n) of the full-layout `in`, at most scratchSize, into [begin, begin + n).
+    // Positions and the constants set at spawn are only written when `spawned` is set. The spawn
+    // origins of new particles are taken relative to offsetOrigin; the update packs them relative to
+    // `origin` when the emitter has moved, and the emitter then moves offsetOrigin along.
+    void Pack(const ParticleStore& in, size_t begin, size_t n, bool spawned) {
+        using namespace rp3d::simd;
+        FloatToHalf(in.vx, packed.vx + begin, n);
+        FloatToHalf(in.vy, packed.vy + begin, n);
+        FloatToHalf(in.vz, packed.vz + begin, n);
+        if (spawned) {
+            std::copy_n(in.px, n, px + begin);
+            std::copy_n(in.py, n, py + begin);
+            std::copy_n(in.pz, n, pz + begin);
+            FloatToHalf(in.originAcceleration, packed.originAcceleration + begin, n);
+            FloatToHalf(in.invTtl, packed.invTtl + begin, n);
+            PackOrigins(in, begin, n, offsetOrigin);
+        }
+        else if (origin.x != offsetOrigin.x || origin.y != offsetOrigin.y || origin.z != offsetOrigin.z) {
+            PackOrigins(in, begin, n, origin);
+        }
+        size_t j = 0;
+        for (; j + Native::width <= n; j += Native::width) {
+            PackLife<Native>(in, j, begin + j);
+        }
+        for (; j < n; ++j) {
+            PackLife<Scalar>(in, j, begin + j);
+        }
+    }
+
+    // Live range as raw bytes for Emitter::SaveState: one memcpy per array, the previous positions last
+    size_t StateBytes(bool history) const {
+        return size * (BytesPerParticle() + (history ? 3 * sizeof(float) : 0));
+    }
+    void SaveState(std::byte* out) const {
+        ForEachArray([&](std::byte* array, size_t width) {
+            std::memcpy(out, array, size * width);
+            out += size * width;
+        });
+        if (prevX) {
+            for (const float* prev : { prevX, prevY, prevZ }) {
+                std::memcpy(out, prev, size * sizeof(float));
+                out += size * sizeof(float);
+            }
+        }
+    }
+    // Same layout as the saving store, `count` no larger than the capacity. Previous positions
+    // missing from the state are taken from the current ones, extra ones are skipped.
+    void RestoreState(const std::byte* in, size_t count, bool history) {
+        size = count;
+        ForEachArray([&](std::byte* array, size_t width) {
+            std::memcpy(array, in, size * width);
+            in += size * width;
+        });
+        if (!prevX) return;
+        if (history) {
+            for (float* prev : { prevX, prevY, prevZ }) {
+                std::memcpy(prev, in, size * sizeof(float));
+                in += size * sizeof(float);
+            }
+        }
+        else {
+            std::copy_n(px, size, prevX);
+            std::copy_n(py, size, prevY);
+            std::copy_n(pz, size, prevZ);
+        }
+    }
+
+    // Full-layout block for unpacking compact stores, one per thread
+    static ParticleStore& Scratch() {
+        thread_local ParticleStore scratch(scratchSize);
+        return scratch;
+    }
+
+private:
+    size_t capacity, maxCapacity, stride, size = 0;
+    std::pmr::memory_resource* memory;
+    size_t floats, halves;  // Array counts, the float arrays come first in the block
+    float* block;
+    bool paged = false;  // The arrays live in a PageReservation sized for maxCapacity
+
+    size_t Bytes() const { return stride * BytesPerParticle(); }
+
+    // A reservation for stores that can grow, the memory resource otherwise or when it fails
+    void* AllocateArrays(size_t bytes, size_t align) {
+        if (paged) {
+            if (void* p = PageReservation::Reserve(bytes)) return p;
+            throw std::bad_alloc();
+        }
+        void* p = memory->allocate(bytes, align);
+        std::memset(p, 0, bytes);
+        return p;
+    }
+    void DeallocateArrays(void* p, size_t bytes) {
+        if (paged) {
+            PageReservation::Release(p, bytes);
+        }
+        else {
+            memory->deallocate(p, bytes, alignment);
+        }
+    }
+
+    // Points the first `floats` and `halves` entries of the lists at consecutive arrays of the block
+    void Allocate(float** const* floatArrays, uint16_t** const* halfArrays) {
+        void* reserved = maxCapacity > capacity ? PageReservation::Reserve(Bytes()) : nullptr;
+        paged = reserved != nullptr;
+        block = static_cast<float*>(paged ? reserved : AllocateArrays(Bytes(), alignment));
+        for (size_t i = 0; i < floats; ++i) {
+            *floatArrays[i] = block + i * stride;
+        }
+        uint16_t* first = reinterpret_cast<uint16_t*>(block + floats * stride);
+        for (size_t i = 0; i < halves; ++i) {
+            *halfArrays[i] = first + i * stride;
+        }
+        if (paged) {
+            ForEachPagedArray([&](std::byte* array, size_t width) { PageReservation::Commit(array, capacity * width); });
+        }
+    }
+
+    template <class F>
+    void UnpackAge(size_t src, ParticleStore& out, size_t dst) const {
+        F life = F::LoadU16(packed.life + src) * F::Set(1.0f / 65535.0f);
+        (life / F::Load(out.invTtl + dst)).Store(out.age + dst);
+    }
+
+    void PackOrigins(const ParticleStore& in, size_t begin, size_t n, Vector3 base) {
+        float offsets[scratchSize];
+        const float* origins[] = { in.ox, in.oy, in.oz };
+        uint16_t* packedOrigins[] = { packed.ox, packed.oy, packed.oz };
+        float at[] = { base.x, base.y, base.z };
+        for (int a = 0; a < 3; ++a) {
+            for (size_t j = 0; j < n; ++j) {
+                offsets[j] = origins[a][j] - at[a];
+            }
+            rp3d::simd::FloatToHalf(offsets, packedOrigins[a] + begin, n);
+        }
+    }
+
+    // Saturated at 1: the kernel flags expired particles before they are packed back
+    template <class F>
+    void PackLife(const ParticleStore& in, size_t src, size_t dst) {
+        F life = Min(Max(F::Load(in.age + src) * F::Load(in.invTtl + src), F::Set(0.0f)), F::Set(1.0f));
+        (life * F::Set(65535.0f)).StoreU16(packed.life + dst);
+    }
+
+    // Calls fn(array, element size) for every array of the block
+    template <class Fn>
+    void ForEachArray(Fn&& fn) const {
+        std::byte* bytes = reinterpret_cast<std::byte*>(block);
+        for (size_t a = 0; a < floats; ++a) {
+            fn(bytes + a * stride * sizeof(float), sizeof(float));
+        }
+        std::byte* first = bytes + floats * stride * sizeof(float);
+        for (size_t a = 0; a < halves; ++a) {
+            fn(first + a * stride * sizeof(uint16_t), sizeof(uint16_t));
+        }
+    }
+
+    // ForEachArray, then the previous positions when kept
+    template <class Fn>
+    void ForEachPagedArray(Fn&& fn) const {
+        ForEachArray(fn);
+        if (prevX) {
+            for (float* prev : { prevX, prevY, prevZ }) {
+                fn(reinterpret_cast<std::byte*>(prev), sizeof(float));
+            }
+        }
+    }
+
+    void CopySlot(size_t dst, size_t src) {
+        for (size_t a = 0; a < floats; ++a) {
+            block[a * stride + dst] = block[a * stride + src];
+        }
+        uint16_t* first = reinterpret_cast<uint16_t*>(block + floats * stride);
+        for (size_t a = 0; a < halves; ++a) {
+            first[a * stride + dst] = first[a * stride + src];
+        }
+        if (prevX) {
+            prevX[dst] = prevX[src];
+            prevY[dst] = prevY[src];
+            prevZ[dst] = prevZ[src];
+        }
+    }
+};
+
+// Static world geometry that particles bounce off, registered with ParticleSystem::AddCollider.
+// Every shape is solid: particles found inside are pushed out along the closest surface normal.
+enum class ColliderShape {
+    Plane,       // Half-space below the plane
+    Box,         // Axis-aligned box
+    Sphere,
+    Heightfield  // Terrain sampled on a regular grid, solid below the surface
+};
+
+struct Collider {
+    ColliderShape shape = ColliderShape::Plane;
+    float restitution = 0.5f;  // Share of the speed toward the surface kept after a bounce
+    Vector3 normal = { 0.0f, 1.0f, 0.0f };  // Plane, unit length, pointing out of the solid side
+    float distance = 0.0f;  // Plane, points with dot(normal, p) < distance are inside
+    Vector3 center = {};  // Sphere center, or the heightfield's corner with the smallest X and Z
+    float radius = 0.0f;  // Sphere
+    BoundingBox box = {};  // Box extent, filled in for the sphere and the heightfield
+    std::vector<float> heights;  // Heightfield, rows * columns samples row by row, added to center.y
+    int columns = 0, rows = 0;
+    float spacing = 1.0f;  // Heightfield, distance between samples on X and Z
+
+    static Collider Plane(const Vector3& normal, float distance, float restitution = 0.5f) {
+        Collider c;
+        c.shape = ColliderShape::Plane;
+        c.normal = Vector3Normalize(normal);
+        c.distance = distance;
+        c.restitution = restitution;
+        return c;
+    }
+
+    static Collider Box(const BoundingBox& box, float restitution = 0.5f) {
+        Collider c;
+        c.shape = ColliderShape::Box;
+        c.box = box;
+        c.restitution = restitution;
+        return c;
+    }
+
+    static Collider Sphere(const Vector3& center, float radius, float restitution = 0.5f) {
+        Collider c;
+        c.shape = ColliderShape::Sphere;
+        c.center = center;
+        c.radius = radius;
+        Vector3 extent = { radius, radius, radius };
+        c.box = { Vector3Subtract(center, extent), Vector3Add(center, extent) };
+        c.restitution = restitution;
+        return c;
+    }
+
+    // `heights` holds at least 2 x 2 samples. The solid reaches one spacing below the lowest one.
+    static Collider Heightfield(const Vector3& corner, float spacing, int columns, int rows,
+                                std::vector<float> heights, float restitution = 0.5f) {
+        Collider c;
+        c.shape = ColliderShape::Heightfield;
+        c.center = corner;
+        c.spacing = std::max(spacing, 1e-6f);
+        c.columns = std::max(columns, 2);
+        c.rows = std::max(rows, 2);
+        c.heights = std::move(heights);
+        c.heights.resize(static_cast<size_t>(c.columns) * c.rows, 0.0f);
+        auto [lo, hi] = std::minmax_element(c.heights.begin(), c.heights.end());
+        c.box = { { corner.x, corner.y + *lo - c.spacing, corner.z },
+                  { corner.x + (c.columns - 1) * c.spacing, corner.y + *hi, corner.z + (c.rows - 1) * c.spacing } };
+        c.restitution = restitution;
+        return c;
+    }
+};
+
+// Colliders with a uniform spatial hash over their boxes: a grid over the colliders' extent whose
+// cells are hashed into a power-of-two table. Each bucket holds a 64-bit mask of collider groups, so
+// a lookup is one load and an OR, whatever the number of colliders. Groups are runs of colliders
+// sorted along a Morton curve, each bit stands for colliders close to each other.
+// The update kernel looks up each tile of particles, or each block of lanes when the tile is too
+// spread out, and resolves the groups found. Planes, and shapes spanning too many cells to be worth
+// hashing, are resolved on every block.
+class ColliderSet {
+public:
+    // A cell size of 0 picks the median size of the colliders when the hash is built
+    explicit ColliderSet(float cellSize = 0.0f) {
+        SetCellSize(cellSize);
+    }
+
+    // Cells about the size of the colliders keep both the groups per cell and the cells per collider few
+    void SetCellSize(float size) {
+        cellSize = std::max(size, 0.0f);
+        built = false;
+    }
+
+    size_t Add(Collider collider) {
+        colliders.push_back(std::move(collider));
+        built = false;
+        return colliders.size() - 1;
+    }
+    void Clear() {
+        colliders.clear();
+        built = false;
+    }
+    bool Empty() const { return colliders.empty(); }
+    size_t Size() const { return colliders.size(); }
+    const Collider& operator[](size_t i) const { return colliders[i]; }
+
+    // Rebuilds the hash after colliders were added. ParticleSystem calls it before the next update.
+    void Build() {
+        RP3D_ZONE("ColliderSet::Build");
+        built = true;
+        buckets.clear();
+        invCell = 1.0f / (cellSize > 0.0f ? cellSize : MedianSize());
+        size_t insertions;
+        BoundingBox region;
+        // The grid must stay small enough for its cell index to be exact in a float, coarser cells otherwise
+        for (;;) {
+            planes.clear();
+            unbounded.clear();
+            hashed.clear();
+            insertions = 0;
+            region = EmptyBox();
+            gridMin = {};
+            for (uint32_t i = 0; i < colliders.size(); ++i) {
+                const Collider& c = colliders[i];
+                if (c.shape == ColliderShape::Plane) {
+                    planes.push_back(i);
+                    continue;
+                }
+                size_t cells = CellCount(c.box);
+                if (cells > maxCells) {
+                    unbounded.push_back(i);
+                    continue;
+                }
+                hashed.push_back(i);
+                insertions += cells;
+                region = { Vector3Min(region.min, c.box.min), Vector3Max(region.max, c.box.max) };
+            }
+            if (hashed.empty()) return;
+            gridMin = region.min;
+            int64_t lo[3], hi[3];
+            CellRange(region, lo, hi);
+            for (int a = 0; a < 3; ++a) {
+                dims[a] = hi[a] + 1;
+            }
+            if (dims[0] * dims[1] * dims[2] <= maxGridCells) break;
+            invCell *= 0.5f;
+        }
+
+        std::vector<uint64_t> codes(colliders.size());
+        for (uint32_t i : hashed) {
+            const BoundingBox& b = colliders[i].box;
+            int64_t lo[3], hi[3];
+            CellRange({ Vector3Lerp(b.min, b.max, 0.5f), Vector3Lerp(b.min, b.max, 0.5f) }, lo, hi);
+            codes[i] = Morton(lo);
+        }
+        std::sort(hashed.begin(), hashed.end(), [&](uint32_t a, uint32_t b) { return codes[a] < codes[b]; });
+        groupSize = (hashed.size() + 63) / 64;
+
+        size_t count = std::bit_ceil(std::max<size_t>(insertions * 2, 64));
+        mask = static_cast<uint32_t>(count - 1);
+        buckets.assign(count, 0);
+        for (size_t k = 0; k < hashed.size(); ++k) {
+            uint64_t bit = uint64_t(1) << (k / groupSize);
+            ForEachCell(colliders[hashed[k]].box, [&](uint32_t bucket) { buckets[bucket] |= bit; });
+        }
+    }
+    bool IsBuilt() const { return built; }
+    // False when every shape is resolved on every block, Query then ignores the box
+    bool IsHashed() const { return !buckets.empty(); }
+    // True when there is more than planes, which ResolvePlanes handles
+    bool HasShapes() const { return !unbounded.empty() || IsHashed(); }
+    // Shapes too large to hash, resolved on every block
+    bool HasUnbounded() const { return !unbounded.empty(); }
+
+    // Groups of the colliders that may touch `box`. False when the box spans too many cells for a
+    // lookup to pay off, QueryLanes should be used on its blocks instead.
+    bool Query(const BoundingBox& box, uint64_t& groups) const {
+        groups = 0;
+        if (!IsHashed()) return true;
+        if (CellCount(box) > maxQueryCells) return false;
+        ForEachCell(box, [&](uint32_t bucket) { groups |= buckets[bucket]; });
+        return true;
+    }
+
+    // Same for one block of lanes, from the cell of each lane. The cell index is computed on all lanes
+    // at once, only the table loads go one lane at a time.
+    template <class F>
+    uint64_t QueryLanes(F px, F py, F pz) const {
+        if (!IsHashed()) return 0;
+        const F inv = F::Set(invCell), zero = F::Set(0.0f);
+        F x = rp3d::simd::Floor((px - F::Set(gridMin.x)) * inv);
+        F y = rp3d::simd::Floor((py - F::Set(gridMin.y)) * inv);
+        F z = rp3d::simd::Floor((pz - F::Set(gridMin.z)) * inv);
+        auto inside = (zero <= x) & (x <= F::Set(dims[0] - 1.0f)) & (zero <= y) & (y <= F::Set(dims[1] - 1.0f))
+            & (zero <= z) & (z <= F::Set(dims[2] - 1.0f));
+        // Lanes off the grid read cell 0 and are masked out after the load, which keeps the loop branch-free
+        F index = MulAdd(MulAdd(z, F::Set(static_cast<float>(dims[1])), y), F::Set(static_cast<float>(dims[0])), x);
+        alignas(64) float cell[F::width];
+        Select(inside, index, zero).Store(cell);
+        unsigned lanes = rp3d::simd::Bits(inside);
+        uint64_t groups = 0;
+        for (size_t j = 0; j < F::width; ++j) {
+            uint64_t keep = uint64_t(0) - ((lanes >> j) & 1);
+            groups |= buckets[static_cast<uint32_t>(cell[j]) & mask] & keep;
+        }
+        return groups;
+    }
+
+    // Planes are cheap and usually hit, the update kernel resolves them while the lanes are in registers.
+    // Branch-free: whether a block touches the floor is too irregular to predict.
+    template <class F>
+    void ResolvePlanes(F& px, F& py, F& pz, F& vx, F& vy, F& vz) const {
+        const F zero = F::Set(0.0f);
+        for (uint32_t i : planes) {
+            const Collider& c = colliders[i];
+            F nx = F::Set(c.normal.x), ny = F::Set(c.normal.y), nz = F::Set(c.normal.z);
+            F depth = Max(F::Set(c.distance) - MulAdd(nx, px, MulAdd(ny, py, nz * pz)), zero);
+            px = MulAdd(nx, depth, px);
+            py = MulAdd(ny, depth, py);
+            pz = MulAdd(nz, depth, pz);
+            F toward = MulAdd(vx, nx, MulAdd(vy, ny, vz * nz));
+            F impulse = Select(depth > zero, Min(toward, zero) * F::Set(-1.0f - c.restitution), zero);
+            vx = MulAdd(nx, impulse, vx);
+            vy = MulAdd(ny, impulse, vy);
+            vz = MulAdd(nz, impulse, vz);
+        }
+    }
+
+    // Resolves the shapes in `groups` and the unhashed ones. Returns false when no lane was inside
+    // any of their boxes, and nothing moved.
+    template <class F>
+    bool Resolve(uint64_t groups, F& px, F& py, F& pz, F& vx, F& vy, F& vz) const {
+        bool moved = false;
+        for (uint32_t i : unbounded) {
+            moved |= ResolveShape(colliders[i], px, py, pz, vx, vy, vz);
+        }
+        for (; groups != 0; groups &= groups - 1) {
+            size_t first = std::countr_zero(groups) * groupSize;
+            size_t last = std::min(first + groupSize, hashed.size());
+            for (size_t k = first; k < last; ++k) {
+                moved |= ResolveShape(colliders[hashed[k]], px, py, pz, vx, vy, vz);
+            }
+        }
+        return moved;
+    }
+
+private:
+    static constexpr size_t maxCells = 4096;  // Larger shapes are resolved on every block
+    static constexpr size_t maxQueryCells = 64;  // Larger tiles are looked up lane by lane
+    static constexpr int64_t maxGridCells = int64_t(1) << 24;
+
+    std::vector<Collider> colliders;
+    std::vector<uint32_t> planes, unbounded;
+    std::vector<uint32_t> hashed;  // In Morton order, group g is [g * groupSize, (g + 1) * groupSize)
+    size_t groupSize = 1;
+    std::vector<uint64_t> buckets;  // Groups with a collider in a cell hashing to the bucket
+    float cellSize = 0.0f, invCell = 1.0f;
+    Vector3 gridMin = {};  // Corner of cell (0, 0, 0)
+    int64_t dims[3] = { 0, 0, 0 };  // Grid cells along each axis
+    uint32_t mask = 0;
+    bool built = true;
+
+    static BoundingBox EmptyBox() {
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        return { { inf, inf, inf }, { -inf, -inf, -inf } };
+    }
+
+    // Median of the largest edge of each bounded collider's box
+    float MedianSize() const {
+        std::vector<float> sizes;
+        for (const Collider& c : colliders) {
+            if (c.shape == ColliderShape::Plane) continue;
+            Vector3 e = Vector3Subtract(c.box.max, c.box.min);
+            sizes.push_back(std::max({ e.x, e.y, e.z }));
+        }
+        if (sizes.empty()) return 1.0f;
+        std::nth_element(sizes.begin(), sizes.begin() + sizes.size() / 2, sizes.end());
+        return std::max(sizes[sizes.size() / 2], 1e-2f);
+    }
+
+    // Interleaves the low 21 bits of each cell coordinate
+    static uint64_t Morton(const int64_t cell[3]) {
+        uint64_t code = 0;
+        for (int b = 0; b < 21; ++b) {
+            for (int a = 0; a < 3; ++a) {
+                code |= ((static_cast<uint64_t>(cell[a]) >> b) & 1) << (3 * b + a);
+            }
+        }
+        return code;
+    }
+
+    // Clamped so stray particles far out do not overflow the cell coordinates
+    static int64_t Coordinate(float cell) {
+        return static_cast<int64_t>(std::clamp(cell, -1e9f, 1e9f));
+    }
+
+    // Linear index of a grid cell, folded into the table. Cells of a row hash to neighbouring buckets.
+    uint32_t Bucket(int64_t x, int64_t y, int64_t z) const {
+        return static_cast<uint32_t>(x + dims[0] * (y + dims[1] * z)) & mask;
+    }
+
+    // Same subtract, multiply and floor as QueryLanes, so a point and the box holding it agree on the cell
+    void CellRange(const BoundingBox& box, int64_t lo[3], int64_t hi[3]) const {
+        const float min[3] = { box.min.x - gridMin.x, box.min.y - gridMin.y, box.min.z - gridMin.z };
+        const float max[3] = { box.max.x - gridMin.x, box.max.y - gridMin.y, box.max.z - gridMin.z };
+        for (int a = 0; a < 3; ++a) {
+            lo[a] = Coordinate(std::floor(min[a] * invCell));
+            hi[a] = Coordinate(std::floor(max[a] * invCell));
+        }
+    }
+
+    // Cells of the grid inside `box`, every cell it spans before the grid is laid out
+    void GridRange(const BoundingBox& box, int64_t lo[3], int64_t hi[3]) const {
+        CellRange(box, lo, hi);
+        if (!IsHashed()) return;
+        for (int a = 0; a < 3; ++a) {
+            lo[a] = std::max<int64_t>(lo[a], 0);
+            hi[a] = std::min(hi[a], dims[a] - 1);
+        }
+    }
+
+    size_t CellCount(const BoundingBox& box) const {
+        int64_t lo[3], hi[3];
+        GridRange(box, lo, hi);
+        // Empty or inverted boxes touch no cell, huge ones saturate
+        double cells = 1.0;
+        for (int a = 0; a < 3; ++a) {
+            cells *= static_cast<double>(std::max<int64_t>(hi[a] - lo[a] + 1, 0));
+        }
+        return static_cast<size_t>(std::min(cells, 1e12));
+    }
+
+    template <class Fn>
+    void ForEachCell(const BoundingBox& box, Fn&& fn) const {
+        int64_t lo[3], hi[3];
+        GridRange(box, lo, hi);
+        for (int64_t x = lo[0]; x <= hi[0]; ++x) {
+            for (int64_t y = lo[1]; y <= hi[1]; ++y) {
+                for (int64_t z = lo[2]; z <= hi[2]; ++z) {
+                    fn(Bucket(x, y, z));
+                }
+            }
+        }
+    }
+
+    // Pushes the lanes inside `c` out to its surface and reflects their velocity. Returns false when
+    // no lane was inside the collider's box, and nothing moved.
+    template <class F>
+    static bool ResolveShape(const Collider& c, F& px, F& py, F& pz, F& vx, F& vy, F& vz) {
+        const F zero = F::Set(0.0f), one = F::Set(1.0f);
+        // Most candidates miss every lane, their box alone tells
+        auto in = (F::Set(c.box.min.x) <= px) & (px <= F::Set(c.box.max.x)) & (F::Set(c.box.min.y) <= py)
+            & (py <= F::Set(c.box.max.y)) & (F::Set(c.box.min.z) <= pz) & (pz <= F::Set(c.box.max.z));
+        if (rp3d::simd::Bits(in) == 0) return false;
+        F nx, ny, nz, dist;
+        switch (c.shape) {
+        case ColliderShape::Plane:
+            return false;  // ResolvePlanes
+        case ColliderShape::Sphere: {
+            F dx = px - F::Set(c.center.x), dy = py - F::Set(c.center.y), dz = pz - F::Set(c.center.z);
+            F len = Sqrt(MulAdd(dx, dx, MulAdd(dy, dy, dz * dz)));
+            // A particle exactly at the center is pushed up
+            auto away = len > zero;
+            F inv = Select(away, one / len, zero);
+            nx = dx * inv;
+            ny = Select(away, dy * inv, one);
+            nz = dz * inv;
+            dist = len - F::Set(c.radius);
+            break;
+        }
+        case ColliderShape::Box: {
+            // Depth below each face, the shallowest one is the way out
+            F depth[6] = { px - F::Set(c.box.min.x), F::Set(c.box.max.x) - px, py - F::Set(c.box.min.y),
+                           F::Set(c.box.max.y) - py, pz - F::Set(c.box.min.z), F::Set(c.box.max.z) - pz };
+            F best = depth[0], inside = Select(depth[0] > zero, one, zero);
+            nx = F::Set(-1.0f);
+            ny = nz = zero;
+            for (int f = 1; f < 6; ++f) {
+                inside = Select(depth[f] > zero, inside, zero);
+                auto closer = best > depth[f];
+                best = Select(closer, depth[f], best);
+                F sign = F::Set(f % 2 ? 1.0f : -1.0f);
+                nx = Select(closer, f / 2 == 0 ? sign : zero, nx);
+                ny = Select(closer, f / 2 == 1 ? sign : zero, ny);
+                nz = Select(closer, f / 2 == 2 ? sign : zero, nz);
+            }
+            dist = Select(inside > zero, zero - best, one);
+            break;
+        }
+        case ColliderShape::Heightfield:
+            dist = Terrain(c, in, px, py, pz, nx, ny, nz);
+            break;
+        }
+
+        // No early out on a miss from here, which lanes end up inside is too irregular to predict
+        auto hit = zero > dist;
+        F push = Select(hit, zero - dist, zero);
+        px = MulAdd(nx, push, px);
+        py = MulAdd(ny, push, py);
+        pz = MulAdd(nz, push, pz);
+        // Only the lanes moving into the surface bounce, tangential motion is kept
+        F toward = MulAdd(vx, nx, MulAdd(vy, ny, vz * nz));
+        F impulse = Select(hit & (zero > toward), toward * F::Set(-1.0f - c.restitution), zero);
+        vx = MulAdd(nx, impulse, vx);
+        vy = MulAdd(ny, impulse, vy);
+        vz = MulAdd(nz, impulse, vz);
+        return true;
+    }
+
+    // Distance below the heightfield surface, measured along its normal, for the lanes over the grid
+    // flagged in `inside`; 1 for the others, which read the first cell.
+    template <class F, class M>
+    static F Terrain(const Collider& c, M inside, F px, F py, F pz, F& nx, F& ny, F& nz) {
+        const F zero = F::Set(0.0f), one = F::Set(1.0f), inv = F::Set(1.0f / c.spacing);
+        F u = (px - F::Set(c.center.x)) * inv, v = (pz - F::Set(c.center.z)) * inv;
+        F i0 = Select(inside, Min(rp3d::simd::Floor(u), F::Set(c.columns - 2.0f)), zero);
+        F k0 = Select(inside, Min(rp3d::simd::Floor(v), F::Set(c.rows - 2.0f)), zero);
+        F fu = Select(inside, u - i0, zero), fv = Select(inside, v - k0, zero);
+        F index = MulAdd(k0, F::Set(static_cast<float>(c.columns)), i0);
+        const float* h = c.heights.data();
+        F h00 = F::Gather(h, index), h01 = F::Gather(h + 1, index);
+        F h10 = F::Gather(h + c.columns, index), h11 = F::Gather(h + c.columns + 1, index);
+        F h0 = MulAdd(h01 - h00, fu, h00), h1 = MulAdd(h11 - h10, fu, h10);
+        F height = MulAdd(h1 - h0, fv, h0) + F::Set(c.center.y);
+        // Surface slope of the bilinear patch
+        F dx = MulAdd((h11 - h10) - (h01 - h00), fv, h01 - h00) * inv;
+        F dz = (h1 - h0) * inv;
+        F scale = one / Sqrt(MulAdd(dx, dx, MulAdd(dz, dz, one)));
+        nx = (zero - dx) * scale;
+        ny = scale;
+        nz = (zero - dz) * scale;
+        return Select(inside, (py - height) * scale, one);
+    }
+};
+
+// Force fields that change the particles' velocity before the update kernel integrates it. An affector
+// is a plain struct with an Apply template over lane types, so the compiler inlines it into its pass.
+// Each affector attached to an emitter or a ParticleSystem runs as one SIMD pass over every tile of
+// particles while the tile is in cache, through one indirect call per tile rather than per particle.
+
+// Pulls the particles' velocity toward the wind's at `strength` per second: a drag relative to moving air
+struct Wind {
+    Vector3 velocity = { 1.0f, 0.0f, 0.0f };
+    float strength = 1.0f;
+
+    template <class F>
+    void Apply(F, F, F, F& vx, F& vy, F& vz, F dt) const {
+        F t = Min(F::Set(strength) * dt, F::Set(1.0f));
+        vx = MulAdd(F::Set(velocity.x) - vx, t, vx);
+        vy = MulAdd(F::Set(velocity.y) - vy, t, vy);
+        vz = MulAdd(F::Set(velocity.z) - vz, t, vz);
+    }
+};
+
+// Linear air resistance, integrated implicitly so large coefficients stay stable
+struct Drag {
+    float coefficient = 1.0f;
+
+    template <class F>
+    void Apply(F, F, F, F& vx, F& vy, F& vz, F dt) const {
+        F keep = F::Set(1.0f) / MulAdd(F::Set(coefficient), dt, F::Set(1.0f));
+        vx = vx * keep;
+        vy = vy * keep;
+        vz = vz * keep;
+    }
+};
+
+// Swirls the particles around the line through `center` along `axis`. The tangential acceleration
+// peaks at `radius` from the axis and falls off with the distance beyond it.
+struct Vortex {
+    Vector3 center = { 0.0f, 0.0f, 0.0f };
+    Vector3 axis = { 0.0f, 1.0f, 0.0f };
+    float strength = 1.0f;
+    float radius = 1.0f;
+
+    template <class F>
+    void Apply(F px, F py, F pz, F& vx, F& vy, F& vz, F dt) const {
+        Vector3 a = Vector3Normalize(axis);
+        F ax = F::Set(a.x), ay = F::Set(a.y), az = F::Set(a.z);
+        F dx = px - F::Set(center.x), dy = py - F::Set(center.y), dz = pz - F::Set(center.z);
+        // axis x d is tangential, its length the distance from the axis
+        F tx = ay * dz - az * dy, ty = az * dx - ax * dz, tz = ax * dy - ay * dx;
+        F d2 = MulAdd(tx, tx, MulAdd(ty, ty, tz * tz));
+        F k = F::Set(2.0f * strength * radius) * dt / (d2 + F::Set(radius * radius));
+        vx = MulAdd(tx, k, vx);
+        vy = MulAdd(ty, k, vy);
+        vz = MulAdd(tz, k, vz);
+    }
+};
+
+// Inverse-square pull toward `center`, softened within `radius` so it fades to zero at the center.
+// A negative strength repels.
+struct Attractor {
+    Vector3 center = { 0.0f, 0.0f, 0.0f };
+    float strength = 1.0f;
+    float radius = 0.5f;
+
+    template <class F>
+    void Apply(F px, F py, F pz, F& vx, F& vy, F& vz, F dt) const {
+        F dx = F::Set(center.x) - px, dy = F::Set(center.y) - py, dz = F::Set(center.z) - pz;
+        F d2 = MulAdd(dx, dx, MulAdd(dy, dy, MulAdd(dz, dz, F::Set(radius * radius))));
+        F k = F::Set(strength) * dt / (d2 * Sqrt(d2));
+        vx = MulAdd(dx, k, vx);
+        vy = MulAdd(dy, k, vy);
+        vz = MulAdd(dz, k, vz);
+    }
+};
+
+// Divergence-free turbulence: the curl of a sinusoidal vector potential of spatial `frequency`. Being
+// divergence-free, it swirls particles without bunching them up. Move `offset` over time to animate it.
+struct Turbulence {
+    float strength = 1.0f;
+    float frequency = 1.0f;
+    Vector3 offset = { 0.0f, 0.0f, 0.0f };
+
+    // Potential (sin(y + 0.7) cos(z + 1.9), sin(z + 2.3) cos(x + 0.4), sin(x + 1.3) cos(y + 2.9)) in
+    // scaled coordinates; the phases keep its three components unrelated
+    template <class F>
+    void Apply(F px, F py, F pz, F& vx, F& vy, F& vz, F dt) const {
+        const F f = F::Set(frequency);
+        F x = MulAdd(px, f, F::Set(offset.x)), y = MulAdd(py, f, F::Set(offset.y));
+        F z = MulAdd(pz, f, F::Set(offset.z));
+        F sy0, cy0, sz0, cz0, sz1, cz1, sx1, cx1, sx2, cx2, sy2, cy2;
+        rp3d::simd::SinCos(y + F::Set(0.7f), sy0, cy0);
+        rp3d::simd::SinCos(z + F::Set(1.9f), sz0, cz0);
+        rp3d::simd::SinCos(z + F::Set(2.3f), sz1, cz1);
+        rp3d::simd::SinCos(x + F::Set(0.4f), sx1, cx1);
+        rp3d::simd::SinCos(x + F::Set(1.3f), sx2, cx2);
+        rp3d::simd::SinCos(y + F::Set(2.9f), sy2, cy2);
+        // curl = (dAz/dy - dAy/dz, dAx/dz - dAz/dx, dAy/dx - dAx/dy)
+        F k = F::Set(strength) * dt;
+        vx = MulAdd(F::Set(0.0f) - sx2 * sy2 - cz1 * cx1, k, vx);
+        vy = MulAdd(F::Set(0.0f) - sy0 * sz0 - cx2 * cy2, k, vy);
+        vz = MulAdd(F::Set(0.0f) - sz1 * sx1 - cy0 * cz0, k, vz);
+    }
+};
+
+// Affectors fused at compile time into one pass, e.g. AffectorChain<Drag, Wind>{ { { 0.5f }, { wind } } }
+// or Chain(Drag{ 0.5f }, Wind{ wind }). The velocities are loaded and stored once for all of them.
+template <class... A>
+struct AffectorChain {
+    std::tuple<A...> affectors;
+
+    template <class F>
+    void Apply(F px, F py, F pz, F& vx, F& vy, F& vz, F dt) const {
+        std::apply([&](const A&... a) { (a.Apply(px, py, pz, vx, vy, vz, dt), ...); }, affectors);
+    }
+};
+
+template <class... A>
+AffectorChain<A...> Chain(A... affectors) {
+    return { { std::move(affectors)... } };
+}
+
+// The affectors of an emitter or a system, in the order they were added. Any type with the Apply
+// template above can be added.
+class AffectorList {
+public:
+    template <class A>
+    size_t Add(A affector) {
+        passes.push_back({ &Run<std::decay_t<A>>, std::make_shared<const std::decay_t<A>>(std::move(affector)) });
+        return passes.size() - 1;
+    }
+    void Clear() { passes.clear(); }
+    bool Empty() const { return passes.empty(); }
+    size_t Size() const { return passes.size(); }
+
+    // Runs every pass over the slots [begin, end) of `s`, whose positions are not moved
+    void Apply(ParticleStore& s, size_t begin, size_t end, float dt) const {
+        for (const Pass& pass : passes) {
+            pass.run(pass.affector.get(), s, begin, end, dt);
+        }
+    }
+
+private:
+    struct Pass {
+        void (*run)(const void*, ParticleStore&, size_t, size_t, float);
+        std::shared_ptr<const void> affector;
+    };
+    std::vector<Pass> passes;
+
+    template <class A>
+    static void Run(const void* affector, ParticleStore& s, size_t begin, size_t end, float dt) {
+        const A& a = *static_cast<const A*>(affector);
+        constexpr size_t width = rp3d::simd::Native::width;
+        size_t i = begin;
+        for (; i + width <= end; i += width) {
+            Block<rp3d::simd::Native>(a, s, i, dt);
+        }
+        for (; i < end; ++i) {
+            Block<rp3d::simd::Scalar>(a, s, i, dt);
+        }
+    }
+
+    template <class F, class A>
+    static void Block(const A& a, ParticleStore& s, size_t i, float dt) {
+        F vx = F::Load(s.vx + i), vy = F::Load(s.vy + i), vz = F::Load(s.vz + i);
+        a.Apply(F::Load(s.px + i), F::Load(s.py + i), F::Load(s.pz + i), vx, vy, vz, F::Set(dt));
+        vx.Store(s.vx + i);
+        vy.Store(s.vy + i);
+        vz.Store(s.vz + i);
+    }
+};
+
+// Optional stages of the update kernel. Each combination is compiled into its own kernel, picked once per
+// update from the emitter's config, so the hot loop only holds the math the emitter needs.
+enum KernelFeature : unsigned {
+    KernelAcceleration = 1,  // Gravity and external acceleration
+    KernelAttraction = 2,  // Pull toward the spawn origin
+    KernelFloor = 4,  // Bounce on the y = -1 floor
+    KernelScale = 8,  // Draw scale from the distance to the origin
+    KernelAllFeatures = 15
+};
+
+// Per-frame constants shared by every lane of the update kernel
+struct KernelParams {
+    float dt, gravity;
+    Vector3 origin, externalAcceleration;
+    bool collision;  // Bounce on the y = -1 floor
+    const ColliderSet* colliders = nullptr;  // Bounce on these instead, built and not empty
+    const AffectorList* affectors[2] = {};  // The emitter's, then its system's, applied before integrating
+    unsigned features = KernelAllFeatures;  // The stages to run, the others are compiled out
+
+    // The stages an emitter needs: the others would add zero or leave the field as spawned
+    static unsigned Features(const EmitterConfig& config, bool floor) {
+        const Vector3& a = config.externalAcceleration;
+        unsigned features = 0;
+        if (config.gravity != 0.0f || a.x != 0.0f || a.y != 0.0f || a.z != 0.0f) features |= KernelAcceleration;
+        if (config.originAcceleration.min != 0.0f || config.originAcceleration.max != 0.0f) {
+            features |= KernelAttraction;
+        }
+        if (floor) features |= KernelFloor;
+        if (config.scaleByDistance) features |= KernelScale;
+        return features;
+    }
+};
+
+// Branch-free particle update: full SIMD blocks followed by a scalar tail.
+// Covers gravity, origin attraction, external acceleration, ground bounce and distance scaling.
+// Affectors run first, one pass each over a tile of particles, then the tile is integrated.
+// With colliders, particles are processed in tiles: each tile is integrated and bounced off the
+// planes, then resolved against the shapes the spatial hash finds around it.
+struct ParticleKernel {
+    // Updates slots [begin, end), appends the indices of particles that expired to `expired`
+    // in ascending order and returns how many were written. Expired particles are integrated too,
+    // the caller drops them with ParticleStore::Remove. `bounds` is grown to hold every new position.
+    static size_t Update(ParticleStore& s, size_t begin, size_t end, const KernelParams& k, uint32_t* expired,
+                         BoundingBox& bounds) {
+        if (s.IsCompact()) {
+            return UpdatePacked(s, begin, end, k, expired, bounds);
+        }
+        static const auto kernels = Kernels(std::make_index_sequence<KernelAllFeatures + 1>());
+        return kernels[k.features & KernelAllFeatures](s, begin, end, k, expired, bounds);
+    }
+
+    // Inverted box that any Merge replaces
+    static BoundingBox EmptyBounds() {
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        return { { inf, inf, inf }, { -inf, -inf, -inf } };
+    }
+
+private:
+    using Kernel = size_t (*)(ParticleStore&, size_t, size_t, const KernelParams&, uint32_t*, BoundingBox&);
+
+    template <unsigned Features>
+    static size_t Specialized(ParticleStore& s, size_t begin, size_t end, const KernelParams& k, uint32_t* expired,
+                              BoundingBox& bounds) {
+        size_t count = 0;
+        LaneBounds<rp3d::simd::Native> wide;
+        size_t i = Tiles<rp3d::simd::Native, Features>(s, begin, end, k, expired, count, wide);
+        LaneBounds<rp3d::simd::Scalar> tail;
+        Tiles<rp3d::simd::Scalar, Features>(s, i, end, k, expired, count, tail);
+        wide.Merge(bounds);
+        tail.Merge(bounds);
+        return count;
+    }
+
+    // One kernel per combination of features, indexed by the feature bits
+    template <size_t... Features>
+    static std::array<Kernel, sizeof...(Features)> Kernels(std::index_sequence<Features...>) {
+        return { &Specialized<Features>... };
+    }
+
+    // Compact layout: each block is unpacked into the thread's scratch store, updated there and packed
+    // back. The scratch positions point into the store, so positions are updated in place.
+    static size_t UpdatePacked(ParticleStore& s, size_t begin, size_t end, const KernelParams& k, uint32_t* expired,
+                               BoundingBox& bounds) {
+        ParticleStore& scratch = ParticleStore::Scratch();
+        float* positions[3] = { scratch.px, scratch.py, scratch.pz };
+        // The compact layout recomputes the scale when drawing
+        KernelParams unscaled = k;
+        unscaled.features &= ~KernelScale;
+        size_t count = 0;
+        for (size_t b = begin; b < end; b += ParticleStore::scratchSize) {
+            size_t n = std::min(ParticleStore::scratchSize, end - b);
+            scratch.px = s.px + b;
+            scratch.py = s.py + b;
+            scratch.pz = s.pz + b;
+            if (s.prevX) {
+                scratch.prevX = s.prevX + b;
+                scratch.prevY = s.prevY + b;
+                scratch.prevZ = s.prevZ + b;
+            }
+            s.Unpack(b, n, scratch);
+            size_t dead = Update(scratch, 0, n, unscaled, expired + count, bounds);
+            for (size_t j = 0; j < dead; ++j) {
+                expired[count + j] += static_cast<uint32_t>(b);
+            }
+            count += dead;
+            s.Pack(scratch, b, n, false);
+        }
+        scratch.px = positions[0];
+        scratch.py = positions[1];
+        scratch.pz = positions[2];
+        scratch.prevX = scratch.prevY = scratch.prevZ = nullptr;
+        return count;
+    }
+
+    // Per-lane running min/max of the positions, reduced once at the end of Update
+    template <class F>
+    struct LaneBounds {
+        F lo[3], hi[3];
+
+        LaneBounds() {
+            for (int a = 0; a < 3; ++a) {
+                lo[a] = F::Set(std::numeric_limits<float>::infinity());
+                hi[a] = F::Set(-std::numeric_limits<float>::infinity());
+            }
+        }
+
+        void Add(F x, F y, F z) {
+            lo[0] = Min(lo[0], x);
+            lo[1] = Min(lo[1], y);
+            lo[2] = Min(lo[2], z);
+            hi[0] = Max(hi[0], x);
+            hi[1] = Max(hi[1], y);
+            hi[2] = Max(hi[2], z);
+        }
+
+        void Add(const LaneBounds& o) {
+            for (int a = 0; a < 3; ++a) {
+                lo[a] = Min(lo[a], o.lo[a]);
+                hi[a] = Max(hi[a], o.hi[a]);
+            }
+        }
+
+        void Merge(BoundingBox& box) const {
+            alignas(64) float l[3][F::width], h[3][F::width];
+            for (int a = 0; a < 3; ++a) {
+                lo[a].Store(l[a]);
+                hi[a].Store(h[a]);
+            }
+            // std::min rather than Vector3Min, whose fminf calls dominate once this runs per tile
+            float* min[3] = { &box.min.x, &box.min.y, &box.min.z };
+            float* max[3] = { &box.max.x, &box.max.y, &box.max.z };
+            for (int a = 0; a < 3; ++a) {
+                for (size_t j = 0; j < F::width; ++j) {
+                    *min[a] = std::min(*min[a], l[a][j]);
+                    *max[a] = std::max(*max[a], h[a][j]);
+                }
+            }
+        }
+    };
+
+    static constexpr size_t tileSize = 64;
+
+    // Updates whole F blocks from `i`, one tile at a time, and returns where the blocks stop
+    template <class F, unsigned Features>
+    static size_t Tiles(ParticleStore& s, size_t i, size_t end, const KernelParams& k, uint32_t* expired,
+                        size_t& count, LaneBounds<F>& bounds) {
+        constexpr size_t width = F::width;
+        while (i + width <= end) {
+            size_t tileEnd = i + std::min(tileSize, (end - i) / width * width);
+            LaneBounds<F> tile;
+            for (const AffectorList* affectors : k.affectors) {
+                if (affectors) {
+                    affectors->Apply(s, i, tileEnd, k.dt);
+                }
+            }
+            for (size_t j = i; j < tileEnd; j += width) {
+                unsigned dead = ~Lanes<F, Features>(s, j, k, tile) & ((1u << width) - 1);
+                for (; dead != 0; dead &= dead - 1) {
+                    expired[count++] = static_cast<uint32_t>(j + std::countr_zero(dead));
+                }
+            }
+            if (k.colliders && k.colliders->HasShapes()) {
+                Collide(s, i, tileEnd, *k.colliders, tile);
+            }
+            bounds.Add(tile);
+            i = tileEnd;
+        }
+        return i;
+    }
+
+    // Resolves a tile against the colliders near it. The tile bounds keep the positions from
+    // before the push as well, they stay conservative.
+    template <class F>
+    static void Collide(ParticleStore& s, size_t begin, size_t end, const ColliderSet& colliders, LaneBounds<F>& tile) {
+        BoundingBox box = EmptyBounds();
+        if (colliders.IsHashed()) {
+            tile.Merge(box);
+        }
+        uint64_t groups;
+        bool spread = !colliders.Query(box, groups);
+        bool always = colliders.HasUnbounded();
+        if (!spread && groups == 0 && !always) return;
+        for (size_t i = begin; i < end; i += F::width) {
+            F px = F::Load(s.px + i), py = F::Load(s.py + i), pz = F::Load(s.pz + i);
+            uint64_t lanes = spread ? colliders.QueryLanes(px, py, pz) : groups;
+            if (lanes == 0 && !always) continue;
+            F vx = F::Load(s.vx + i), vy = F::Load(s.vy + i), vz = F::Load(s.vz + i);
+            if (!colliders.Resolve(lanes, px, py, pz, vx, vy, vz)) continue;
+            tile.Add(px, py, pz);
+            px.Store(s.px + i);
+            py.Store(s.py + i);
+            pz.Store(s.pz + i);
+            vx.Store(s.vx + i);
+            vy.Store(s.vy + i);
+            vz.Store(s.vz + i);
+        }
+    }
+
+    // Returns one bit per lane, set when the particle is still alive
+    template <class F, unsigned Features>
+    static unsigned Lanes(ParticleStore& s, size_t i, const KernelParams& k, LaneBounds<F>& bounds) {
+        const F zero = F::Set(0.0f);
+        const F dt = F::Set(k.dt);
+
+        F age = F::Load(s.age + i) + dt;
+        age.Store(s.age + i);
+        auto live = age * F::Load(s.invTtl + i) <= F::Set(1.0f);
+
+        F px = F::Load(s.px + i), py = F::Load(s.py + i), pz = F::Load(s.pz + i);
+        F vx = F::Load(s.vx + i), vy = F::Load(s.vy + i), vz = F::Load(s.vz + i);
+        if (s.prevX) {
+            px.Store(s.prevX + i);
+            py.Store(s.prevY + i);
+            pz.Store(s.prevZ + i);
+        }
+
+        if constexpr ((Features & KernelAcceleration) != 0) {
+            vy = vy - F::Set(k.gravity * k.dt);
+            vx = vx + F::Set(k.externalAcceleration.x * k.dt);
+            vy = vy + F::Set(k.externalAcceleration.y * k.dt);
+            vz = vz + F::Set(k.externalAcceleration.z * k.dt);
+        }
+
+        if constexpr ((Features & KernelAttraction) != 0) {
+            // Normalized pull toward the spawn origin, zero when the particle sits on it
+            F dx = F::Load(s.ox + i) - px, dy = F::Load(s.oy + i) - py, dz = F::Load(s.oz + i) - pz;
+            F len = Sqrt(MulAdd(dx, dx, MulAdd(dy, dy, dz * dz)));
+            F pull = Select(len > zero, F::Load(s.originAcceleration + i) * dt / len, zero);
+            vx = MulAdd(dx, pull, vx);
+            vy = MulAdd(dy, pull, vy);
+            vz = MulAdd(dz, pull, vz);
+        }
+
+        px = MulAdd(vx, dt, px);
+        py = MulAdd(vy, dt, py);
+        pz = MulAdd(vz, dt, pz);
+
+        if constexpr ((Features & KernelFloor) != 0) {
+            // Simple bounce with energy loss on the y = -1 floor
+            const F floor = F::Set(-1.0f);
+            auto hit = py <= floor;
+            py = Select(hit, floor, py);
+            vy = Select(hit, vy * F::Set(-0.5f), vy);
+        }
+        if (k.colliders) {
+            k.colliders->ResolvePlanes(px, py, pz, vx, vy, vz);
+        }
+
+        if constexpr ((Features & KernelScale) != 0) {
+            F cx = px - F::Set(k.origin.x), cy = py - F::Set(k.origin.y), cz = pz - F::Set(k.origin.z);
+            F dist = Sqrt(MulAdd(cx, cx, MulAdd(cy, cy, cz * cz)));
+            F scale = F::Set(1.0f) / MulAdd(dist, F::Set(0.1f), F::Set(1.0f));
+            scale.Store(s.scale + i);
+        }
+
+        bounds.Add(px, py, pz);
+        px.Store(s.px + i);
+        py.Store(s.py + i);
+        pz.Store(s.pz + i);
+        vx.Store(s.vx + i);
+        vy.Store(s.vy + i);
+        vz.Store(s.vz + i);
+
+        return rp3d::simd::Bits(live);
+    }
+};
+
+// Per-batch spawn settings. Every range maps a uniform u in [0, 1) to min + u * (max - min).
+struct SpawnParams {
+    FloatRange theta, phi;  // Azimuthal angle around Y and polar angle from Y, in radians
+    FloatRange velocity, offset, originAcceleration, ttl;
+    Vector3 origin;
+};
+
+// Builds freshly pushed particles from uniform random numbers that the caller left in their slots:
+// vx = theta, vy = phi, vz = velocity, px = offset, originAcceleration and invTtl hold their own draws.
+struct SpawnKernel {
+    static void Build(ParticleStore& s, size_t begin, size_t end, const SpawnParams& p) {
+        constexpr size_t width = rp3d::simd::Native::width;
+        size_t i = begin;
+        for (; i + width <= end; i += width) {
+            Lanes<rp3d::simd::Native>(s, i, p);
+        }
+        for (; i < end; ++i) {
+            Lanes<rp3d::simd::Scalar>(s, i, p);
+        }
+    }
+
+private:
+    template <class F>
+    static F Lerp(const FloatRange& r, F u) {
+        return MulAdd(u, F::Set(r.max - r.min), F::Set(r.min));
+    }
+
+    template <class F>
+    static void Lanes(ParticleStore& s, size_t i, const SpawnParams& p) {
+        F sinTheta, cosTheta, sinPhi, cosPhi;
+        rp3d::simd::SinCos(Lerp(p.theta, F::Load(s.vx + i)), sinTheta, cosTheta);
+        rp3d::simd::SinCos(Lerp(p.phi, F::Load(s.vy + i)), sinPhi, cosPhi);
+
+        // Already unit length, no normalization needed
+        F dx = sinPhi * cosTheta, dy = cosPhi, dz = sinPhi * sinTheta;
+        F speed = Lerp(p.velocity, F::Load(s.vz + i));
+        F offset = Lerp(p.offset, F::Load(s.px + i));
+        F ox = F::Set(p.origin.x), oy = F::Set(p.origin.y), oz = F::Set(p.origin.z);
+
+        (dx * speed).Store(s.vx + i);
+        (dy * speed).Store(s.vy + i);
+        (dz * speed).Store(s.vz + i);
+        MulAdd(dx, offset, ox).Store(s.px + i);
+        MulAdd(dy, offset, oy).Store(s.py + i);
+        MulAdd(dz, offset, oz).Store(s.pz + i);
+        ox.Store(s.ox + i);
+        oy.Store(s.oy + i);
+        oz.Store(s.oz + i);
+        Lerp(p.originAcceleration, F::Load(s.originAcceleration + i)).Store(s.originAcceleration + i);
+        // Clamped so a zero lifetime stays finite and the particle expires on its first update
+        (F::Set(1.0f) / Max(Lerp(p.ttl, F::Load(s.invTtl + i)), F::Set(1e-6f))).Store(s.invTtl + i);
+        F::Set(0.0f).Store(s.age + i);
+        F::Set(1.0f).Store(s.scale + i);
+    }
+};
+
+// View frustum as six inward-facing planes (normal, distance), normalized so that a plane
+// evaluates to the signed distance of a point
+struct Frustum {
+    Vector4 planes[6];
+
+    // Gribb-Hartmann extraction, `viewProjection` as built by MatrixMultiply(view, projection)
+    static Frustum FromMatrix(const Matrix& m) {
+        Vector4 row[4] = {
+            { m.m0, m.m4, m.m8, m.m12 },
+            { m.m1, m.m5, m.m9, m.m13 },
+            { m.m2, m.m6, m.m10, m.m14 },
+            { m.m3, m.m7, m.m11, m.m15 }
+        };
+        Frustum f;
+        for (int i = 0; i < 3; ++i) {
+            f.planes[i * 2] = Normalize(Add(row[3], row[i], 1.0f));
+            f.planes[i * 2 + 1] = Normalize(Add(row[3], row[i], -1.0f));
+        }
+        return f;
+    }
+
+    bool Intersects(const BoundingBox& box) const {
+        for (const Vector4& p : planes) {
+            // Corner of the box farthest along the plane normal
+            float x = p.x >= 0.0f ? box.max.x : box.min.x;
+            float y = p.y >= 0.0f ? box.max.y : box.min.y;
+            float z = p.z >= 0.0f ? box.max.z : box.min.z;
+            if (p.x * x + p.y * y + p.z * z + p.w < 0.0f) return false;
+        }
+        return true;
+    }
+
+private:
+    static Vector4 Add(const Vector4& a, const Vector4& b, float sign) {
+        return { a.x + b.x * sign, a.y + b.y * sign, a.z + b.z * sign, a.w + b.w * sign };
+    }
+
+    static Vector4 Normalize(const Vector4& p) {
+        float len = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+        return len > 0.0f ? Vector4{ p.x / len, p.y / len, p.z / len, p.w / len } : p;
+    }
+};
+
+// Collects the particles whose bounding sphere (radius times particle scale) touches the frustum
+struct CullKernel {
+    // Writes the indices of the visible particles to `visible` in ascending order and returns their count
+    static size_t Visible(const ParticleStore& s, const Frustum& f, float radius, uint32_t* visible) {
+        constexpr size_t width = rp3d::simd::Native::width;
+        size_t count = 0;
+        size_t i = 0, end = s.Size();
+        for (; i + width <= end; i += width) {
+            for (unsigned in = Lanes<rp3d::simd::Native>(s, i, f, radius); in != 0; in &= in - 1) {
+                visible[count++] = static_cast<uint32_t>(i + std::countr_zero(in));
+            }
+        }
+        for (; i < end; ++i) {
+            if (Lanes<rp3d::simd::Scalar>(s, i, f, radius)) {
+                visible[count++] = static_cast<uint32_t>(i);
+            }
+        }
+        return count;
+    }
+
+private:
+    template <class F>
+    static unsigned Lanes(const ParticleStore& s, size_t i, const Frustum& f, float radius) {
+        F x = F::Load(s.px + i), y = F::Load(s.py + i), z = F::Load(s.pz + i);
+        // The compact layout stores no scale, the unscaled radius is conservative since scale <= 1
+        F limit = s.scale ? F::Set(-radius) * F::Load(s.scale + i) : F::Set(-radius);
+        auto Distance = [&](const Vector4& p) {
+            return MulAdd(x, F::Set(p.x), MulAdd(y, F::Set(p.y), MulAdd(z, F::Set(p.z), F::Set(p.w))));
+        };
+        auto inside = limit <= Distance(f.planes[0]);
+        for (int p = 1; p < 6; ++p) {
+            inside = inside & (limit <= Distance(f.planes[p]));
+        }
+        return rp3d::simd::Bits(inside);
+    }
+};
+
+// Settings for a ThreadPool
+struct ThreadPoolOptions {
+    size_t workerCount = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+    std::vector<int> affinity;  // Core index per worker (reused cyclically), empty leaves placement to the OS
+};
+
+// Persistent work-stealing thread pool. Every worker owns a task queue: it pushes and pops at the back,
+// idle workers steal from the front of the others. Threads outside the pool submit through a shared
+// injection queue. A thread waiting on a loop keeps running tasks, so loops may nest freely
+// (per-emitter tasks spawning per-chunk tasks) without blocking a worker.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t workerCount) : ThreadPool(ThreadPoolOptions{ workerCount, {} }) {}
+
+    explicit ThreadPool(ThreadPoolOptions options = {}) {
+        for (size_t i = 0; i < options.workerCount; ++i) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < options.workerCount; ++i) {
+            workers[i]->thread = std::thread([this, i] { WorkerLoop(i); });
+            if (!options.affinity.empty()) {
+                PinThread(workers[i]->thread, options.affinity[i % options.affinity.size()]);
+            }
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& w : workers) {
+            w->thread.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Pool shared by emitters and particle systems that were not given one explicitly
+    static ThreadPool& Default() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    size_t Concurrency() const { return workers.size() + 1; }
+
+    // Runs fn(i) for every i in [0, count) and returns once all of them finished.
+    // The calling thread runs the first index itself and then helps with queued tasks while it waits.
+    template <class Fn>
+    void ParallelFor(size_t count, Fn&& fn) {
+        using F = std::remove_reference_t<Fn>;
+        if (count <= 1 || workers.empty()) {
+            for (size_t i = 0; i < count; ++i) {
+                fn(i);
+            }
+            return;
+        }
+
+        std::atomic<size_t> pending{ count };
+        Task first{ &Invoke<F>, const_cast<void*>(static_cast<const void*>(&fn)), 0, &pending };
+        size_t self = currentPool == this ? currentWorker : npos;
+        TaskQueue& queue = self != npos ? workers[self]->queue : injected;
+        queued.fetch_add(count - 1, std::memory_order_release);
+        queue.Push(first, 1, count);
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_all();
+
+        Run(first);
+        while (pending.load(std::memory_order_acquire) != 0) {
+            Task t;
+            if (TryGetTask(t, self)) {
+                Run(t);
+            }
+            else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    struct Task {
+        void (*invoke)(void*, size_t);
+        void* fn;
+        size_t index;
+        std::atomic<size_t>* pending;
+    };
+
+    // Ring buffer of tasks guarded by a mutex, grows by doubling and never shrinks
+    class TaskQueue {
+    public:
+        // Pushes copies of `task` with indices [begin, end)
+        void Push(const Task& task, size_t begin, size_t end) {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t count = end - begin;
+            if (size + count > ring.size()) {
+                Grow(size + count);
+            }
+            for (size_t i = begin; i < end; ++i) {
+                Task& slot = ring[(head + size++) & (ring.size() - 1)];
+                slot = task;
+                slot.index = i;
+            }
+        }
+
+        bool PopBack(Task& out) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (size == 0) return false;
+            out = ring[(head + --size) & (ring.size() - 1)];
+            return true;
+        }
+
+        bool PopFront(Task& out) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (size == 0) return false;
+            out = ring[head];
+            head = (head + 1) & (ring.size() - 1);
+            --size;
+            return true;
+        }
+
+    private:
+        std::mutex mutex;
+        std::vector<Task> ring;
+        size_t head = 0, size = 0;
+
+        void Grow(size_t needed) {
+            size_t capacity = std::max<size_t>(64, std::bit_ceil(needed));
+            std::vector<Task> grown(capacity);
+            for (size_t i = 0; i < size; ++i) {
+                grown[i] = ring[(head + i) & (ring.size() - 1)];
+            }
+            ring = std::move(grown);
+            head = 0;
+        }
+    };
+
+    struct alignas(64) Worker {
+        TaskQueue queue;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    TaskQueue injected;
+    alignas(64) std::atomic<size_t> queued{ 0 };  // Tasks sitting in any queue
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    static inline thread_local ThreadPool* currentPool = nullptr;
+    static inline thread_local size_t currentWorker = npos;
+
+    template <class Fn>
+    static void Invoke(void* fn, size_t i) {
+        (*static_cast<Fn*>(fn))(i);
+    }
+
+    static void Run(const Task& t) {
+        t.invoke(t.fn, t.index);
+        t.pending->fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    // Own queue first (most recent task, still warm in cache), then outside submissions, then steal
+    bool TryGetTask(Task& out, size_t self) {
+        if (queued.load(std::memory_order_acquire) == 0) return false;
+        bool found = (self != npos && workers[self]->queue.PopBack(out)) || injected.PopFront(out);
+        for (size_t k = 1; !found && k <= workers.size(); ++k) {
+            size_t victim = (self == npos ? k - 1 : self + k) % workers.size();
+            found = victim != self && workers[victim]->queue.PopFront(out);
+        }
+        if (found) {
+            queued.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return found;
+    }
+
+    void WorkerLoop(size_t index) {
+        currentPool = this;
+        currentWorker = index;
+        for (;;) {
+            Task t;
+            if (TryGetTask(t, index)) {
+                Run(t);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) != 0; });
+            if (stopping) return;
+        }
+    }
+
+    static void PinThread(std::thread& thread, int core) {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#elif defined(_WIN64)
+        SetThreadAffinityMask(thread.native_handle(), 1ull << core);
+#else
+        (void)thread;  // Affinity is not supported on this platform, placement is left to the OS
+        (void)core;
+#endif
+    }
+};
+
+// Neighbor search for InteractionConfig. Every update, the particles are counting-sorted into a uniform
+// grid of `radius` cells and their positions and velocities copied into cell order. Each particle then
+// visits the 9 rows of 3 cells around it, which are contiguous in that order, a SIMD block at a time.
+// The accelerations are added to the velocities before the update kernel integrates them.
+// Work is O(n) for a bounded density; all passes are deterministic, with or without a pool.
+class NeighborGrid {
+public:
+    // `pool` spreads the sort and every pass over its workers, null runs them on the calling thread
+    void Apply(ParticleStore& s, const InteractionConfig& config, float dt, ThreadPool* pool) {
+        RP3D_ZONE("NeighborGrid::Apply");
+        size = s.Size();
+        if (config.model == InteractionModel::None || size < 2 || !(config.radius > 0.0f)) return;
+        Layout(s, config.radius);
+        Sort(s, pool);
+        size_t blocks = (size + blockSize - 1) / blockSize;
+        if (config.model == InteractionModel::Fluid) {
+            Parallel(pool, blocks, [&](size_t b) { Density(b * blockSize, Block(b), config); });
+            Parallel(pool, blocks, [&](size_t b) { Pressure(b * blockSize, Block(b), config); });
+        }
+        else {
+            Parallel(pool, blocks, [&](size_t b) { Flock(b * blockSize, Block(b), config); });
+        }
+        Parallel(pool, blocks, [&](size_t b) { Scatter(s, b * blockSize, Block(b), dt); });
+    }
+
+private:
+    using F = rp3d::simd::Native;
+    static constexpr size_t blockSize = 4096;  // Particles per task of a pass
+    static constexpr size_t sortChunk = 16384;  // Fewest particles per histogram of the sort
+    static constexpr size_t cellsPerParticle = 8;  // Grid cells are radius-sized up to this many per particle
+    static constexpr size_t sampleSize = 4096;  // Positions per axis sampled to find the dense region
+
+    size_t size = 0;
+    float radius = 0.0f, invCell = 1.0f;
+    Vector3 gridMin = {};
+    uint32_t dims[3] = { 0, 0, 0 };
+    size_t cells = 0;
+    // Cell order, padded by a SIMD block so the last one can be loaded whole
+    std::vector<float> x, y, z, vx, vy, vz, invDensity, pressure;
+    std::vector<float> ax, ay, az;  // Accelerations, in cell order
+    std::vector<uint32_t> index;  // Store slot of each sorted particle
+    std::vector<uint32_t> keys;  // Cell of each store slot
+    std::vector<uint32_t> cellStart;  // First sorted particle of each cell, `cells + 1` entries
+    std::vector<uint32_t> histograms;  // One row of `cells` counters per sort chunk
+    std::vector<size_t> rangeStart;
+    std::vector<float> sample;
+
+    size_t Block(size_t b) const { return std::min((b + 1) * blockSize, size); }
+
+    template <class Fn>
+    static void Parallel(ThreadPool* pool, size_t count, Fn&& fn) {
+        if (pool && count > 1) {
+            pool->ParallelFor(count, fn);
+            return;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            fn(i);
+        }
+    }
+
+    // Fits the grid to the particles with radius-sized cells, at most `cellsPerParticle` per particle.
+    // When stray particles stretch the bounds past that, the grid covers the dense region between
+    // sampled quantiles and Coordinate clamps the strays into the border cells. Clamping never puts
+    // two particles more than one cell further apart, so no neighbor is missed. Only a cloud that is
+    // sparse throughout gets larger cells, which then stay nearly empty.
+    void Layout(const ParticleStore& s, float range) {
+        radius = range;
+        F lo[3], hi[3];
+        for (int a = 0; a < 3; ++a) {
+            lo[a] = F::Set(std::numeric_limits<float>::infinity());
+            hi[a] = F::Set(-std::numeric_limits<float>::infinity());
+        }
+        const float* p[3] = { s.px, s.py, s.pz };
+        size_t i = 0;
+        for (; i + F::width <= size; i += F::width) {
+            for (int a = 0; a < 3; ++a) {
+                F v = F::Load(p[a] + i);
+                lo[a] = Min(lo[a], v);
+                hi[a] = Max(hi[a], v);
+            }
+        }
+        float min[3], max[3];
+        for (int a = 0; a < 3; ++a) {
+            min[a] = rp3d::simd::ReduceMin(lo[a]);
+            max[a] = rp3d::simd::ReduceMax(hi[a]);
+            for (size_t j = i; j < size; ++j) {
+                min[a] = std::min(min[a], p[a][j]);
+                max[a] = std::max(max[a], p[a][j]);
+            }
+        }
+        const double limit = static_cast<double>(std::max<size_t>(size * cellsPerParticle, 4096));
+        float cell = radius;
+        if (Fit(min, max, cell) > limit) {
+            // Quantiles of an evenly spaced sample, the window narrows until the cells fit
+            size_t step = std::max<size_t>(size / sampleSize, 1);
+            size_t n = (size + step - 1) / step;
+            sample.resize(3 * n);
+            for (int a = 0; a < 3; ++a) {
+                float* axis = sample.data() + a * n;
+                for (size_t k = 0; k < n; ++k) {
+                    axis[k] = p[a][k * step];
+                }
+                std::sort(axis, axis + n);
+            }
+            for (float q : { 0.001f, 0.01f, 0.05f }) {
+                size_t first = static_cast<size_t>(q * (n - 1)), last = n - 1 - first;
+                for (int a = 0; a < 3; ++a) {
+                    min[a] = sample[a * n + first];
+                    max[a] = sample[a * n + last];
+                }
+                if (Fit(min, max, cell) <= limit) break;
+            }
+            for (double total; (total = Fit(min, max, cell)) > limit;) {
+                cell *= static_cast<float>(std::cbrt(total / limit)) * 1.01f;
+            }
+        }
+        gridMin = { min[0], min[1], min[2] };
+        invCell = 1.0f / cell;
+        cells = static_cast<size_t>(dims[0]) * dims[1] * dims[2];
+    }
+
+    // Sets the grid dimensions for cells of edge `cell` over [min, max] and returns the cell count
+    double Fit(const float* min, const float* max, float cell) {
+        double total = 1.0;
+        for (int a = 0; a < 3; ++a) {
+            // Clamped so stray particles far out cannot overflow the cell coordinates
+            double extent = std::min(static_cast<double>(max[a] - min[a]) / cell, 1e6);
+            dims[a] = static_cast<uint32_t>(extent) + 1;
+            total *= dims[a];
+        }
+        return total;
+    }
+
+    uint32_t Coordinate(float v, float min, int a) const {
+        float c = (v - min) * invCell;
+        return c > 0.0f ? static_cast<uint32_t>(std::min(c, dims[a] - 1.0f)) : 0;
+    }
+
+    uint32_t Key(const ParticleStore& s, size_t i) const {
+        uint32_t cx = Coordinate(s.px[i], gridMin.x, 0);
+        uint32_t cy = Coordinate(s.py[i], gridMin.y, 1);
+        uint32_t cz = Coordinate(s.pz[i], gridMin.z, 2);
+        return (cz * dims[1] + cy) * dims[0] + cx;
+    }
+
+    // Stable parallel counting sort: one histogram per chunk, an exclusive scan over cells then chunks,
+    // and a scatter in which each chunk fills its own slots in order
+    void Sort(const ParticleStore& s, ThreadPool* pool) {
+        size_t chunks = pool ? std::clamp<size_t>(size / sortChunk, 1, pool->Concurrency()) : 1;
+        size_t per = (size + chunks - 1) / chunks;
+        size_t padded = size + F::width;
+        for (auto* v : { &x, &y, &z, &vx, &vy, &vz, &invDensity, &pressure, &ax, &ay, &az }) {
+            v->resize(padded);
+        }
+        index.resize(size);
+        keys.resize(size);
+        cellStart.resize(cells + 1);
+        histograms.resize(chunks * cells);
+
+        Parallel(pool, chunks, [&](size_t c) {
+            uint32_t* row = histograms.data() + c * cells;
+            std::fill_n(row, cells, 0u);
+            for (size_t i = c * per, end = std::min(i + per, size); i < end; ++i) {
+                keys[i] = Key(s, i);
+                ++row[keys[i]];
+            }
+        });
+
+        // Cells are scanned in `chunks` ranges: their totals first, then each range from its base
+        size_t span = (cells + chunks - 1) / chunks;
+        rangeStart.assign(chunks + 1, 0);
+        Parallel(pool, chunks, [&](size_t r) {
+            size_t total = 0;
+            for (size_t cell = r * span, end = std::min(cell + span, cells); cell < end; ++cell) {
+                for (size_t c = 0; c < chunks; ++c) {
+                    total += histograms[c * cells + cell];
+                }
+            }
+            rangeStart[r + 1] = total;
+        });
+        for (size_t r = 0; r < chunks; ++r) {
+            rangeStart[r + 1] += rangeStart[r];
+        }
+        Parallel(pool, chunks, [&](size_t r) {
+            uint32_t run = static_cast<uint32_t>(rangeStart[r]);
+            for (size_t cell = r * span, end = std::min(cell + span, cells); cell < end; ++cell) {
+                cellStart[cell] = run;
+                for (size_t c = 0; c < chunks; ++c) {
+                    uint32_t count = histograms[c * cells + cell];
+                    histograms[c * cells + cell] = run;
+                    run += count;
+                }
+            }
+        });
+        cellStart[cells] = static_cast<uint32_t>(size);
+
+        Parallel(pool, chunks, [&](size_t c) {
+            uint32_t* row = histograms.data() + c * cells;
+            for (size_t i = c * per, end = std::min(i + per, size); i < end; ++i) {
+                index[row[keys[i]]++] = static_cast<uint32_t>(i);
+            }
+        });
+
+        // Gathered rather than scattered along with the index: independent loads overlap better than stores
+        size_t blocks = (size + blockSize - 1) / blockSize;
+        Parallel(pool, blocks, [&](size_t b) {
+            for (size_t d = b * blockSize, end = Block(b); d < end; ++d) {
+                uint32_t i = index[d];
+                x[d] = s.px[i];
+                y[d] = s.py[i];
+                z[d] = s.pz[i];
+                if (s.IsCompact()) {
+                    vx[d] = rp3d::simd::HalfToFloat(s.packed.vx[i]);
+                    vy[d] = rp3d::simd::HalfToFloat(s.packed.vy[i]);
+                    vz[d] = rp3d::simd::HalfToFloat(s.packed.vz[i]);
+                }
+                else {
+                    vx[d] = s.vx[i];
+                    vy[d] = s.vy[i];
+                    vz[d] = s.vz[i];
+                }
+            }
+        });
+    }
+
+    // The 27 cells around a cell, as up to 9 runs of sorted particles: the 3 cells along x of each
+    // row are contiguous
+    struct Rows {
+        size_t from[9], to[9], count = 0;
+    };
+
+    // Calls fn(i, rows) for each sorted particle i in [begin, end). The rows are looked up once per
+    // cell and shared by the particles in it, which also repeats the same loop trip counts.
+    template <class Fn>
+    void ForEachParticle(size_t begin, size_t end, Fn&& fn) const {
+        Rows rows;
+        for (size_t i = begin; i < end;) {
+            uint32_t c[3] = { Coordinate(x[i], gridMin.x, 0), Coordinate(y[i], gridMin.y, 1),
+                              Coordinate(z[i], gridMin.z, 2) };
+            size_t cell = (static_cast<size_t>(c[2]) * dims[1] + c[1]) * dims[0] + c[0];
+            size_t last = std::min<size_t>(cellStart[cell + 1], end);
+            uint32_t left = c[0] > 0 ? c[0] - 1 : 0, right = std::min(c[0] + 1, dims[0] - 1);
+            rows.count = 0;
+            for (uint32_t cz = c[2] > 0 ? c[2] - 1 : 0; cz <= std::min(c[2] + 1, dims[2] - 1); ++cz) {
+                for (uint32_t cy = c[1] > 0 ? c[1] - 1 : 0; cy <= std::min(c[1] + 1, dims[1] - 1); ++cy) {
+                    size_t row = (static_cast<size_t>(cz) * dims[1] + cy) * dims[0];
+                    rows.from[rows.count] = cellStart[row + left];
+                    rows.to[rows.count] = cellStart[row + right + 1];
+                    rows.count += rows.to[rows.count] > rows.from[rows.count];
+                }
+            }
+            for (; i < last; ++i) {
+                fn(i, rows);
+            }
+        }
+    }
+
+    // Lanes of the block at j before the end of its row. The passes loop over the rows themselves:
+    // a callback per block would not be inlined and would keep the sums in memory.
+    static auto Valid(size_t j, size_t end) {
+        alignas(64) static constexpr float lanes[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+        return F::Set(static_cast<float>(static_cast<int64_t>(end - j))) > F::Load(lanes);
+    }
+
+    // Density and pressure of each particle
+    void Density(size_t begin, size_t end, const InteractionConfig& config) {
+        const F h2 = F::Set(radius * radius), invH2 = F::Set(1.0f / (radius * radius)), zero = F::Set(0.0f);
+        const F one = F::Set(1.0f);
+        ForEachParticle(begin, end, [&](size_t i, const Rows& rows) {
+            F xi = F::Set(x[i]), yi = F::Set(y[i]), zi = F::Set(z[i]);
+            F sum = zero;
+            for (size_t row = 0; row < rows.count; ++row) {
+                for (size_t j = rows.from[row]; j < rows.to[row]; j += F::width) {
+                    auto valid = Valid(j, rows.to[row]);
+                    F dx = xi - F::Load(&x[j]), dy = yi - F::Load(&y[j]), dz = zi - F::Load(&z[j]);
+                    F r2 = MulAdd(dx, dx, MulAdd(dy, dy, dz * dz));
+                    F w = one - r2 * invH2;
+                    sum = sum + Select(valid & (h2 > r2), w * w * w, zero);
+                }
+            }
+            // The sum includes the particle itself, at weight 1
+            float rho = rp3d::simd::ReduceAdd(sum);
+            invDensity[i] = 1.0f / rho;
+            pressure[i] = config.stiffness * std::max(rho - config.restDensity, 0.0f);
+        });
+    }
+
+    // Pressure gradient (1 - r / h)^2 and viscosity (1 - r / h) between each pair, symmetric so
+    // momentum is conserved
+    void Pressure(size_t begin, size_t end, const InteractionConfig& config) {
+        const F h2 = F::Set(radius * radius), invH = F::Set(1.0f / radius), zero = F::Set(0.0f);
+        const F one = F::Set(1.0f), half = F::Set(0.5f), viscosity = F::Set(config.viscosity);
+        ForEachParticle(begin, end, [&](size_t i, const Rows& rows) {
+            F xi = F::Set(x[i]), yi = F::Set(y[i]), zi = F::Set(z[i]);
+            F vxi = F::Set(vx[i]), vyi = F::Set(vy[i]), vzi = F::Set(vz[i]), pi = F::Set(pressure[i]);
+            F sx = zero, sy = zero, sz = zero;
+            for (size_t row = 0; row < rows.count; ++row) {
+                for (size_t j = rows.from[row]; j < rows.to[row]; j += F::width) {
+                    auto valid = Valid(j, rows.to[row]);
+                    F dx = xi - F::Load(&x[j]), dy = yi - F::Load(&y[j]), dz = zi - F::Load(&z[j]);
+                    F r2 = MulAdd(dx, dx, MulAdd(dy, dy, dz * dz));
+                    auto near = valid & (h2 > r2) & (r2 > zero);
+                    F invR = rp3d::simd::RSqrt(r2);
+                    F q = one - r2 * invR * invH;
+                    F inv = F::Load(&invDensity[j]);
+                    F push = Select(near, (pi + F::Load(&pressure[j])) * half * inv * q * q * invR, zero);
+                    F drag = Select(near, viscosity * inv * q, zero);
+                    sx = MulAdd(dx, push, MulAdd(F::Load(&vx[j]) - vxi, drag, sx));
+                    sy = MulAdd(dy, push, MulAdd(F::Load(&vy[j]) - vyi, drag, sy));
+                    sz = MulAdd(dz, push, MulAdd(F::Load(&vz[j]) - vzi, drag, sz));
+                }
+            }
+            ax[i] = rp3d::simd::ReduceAdd(sx);
+            ay[i] = rp3d::simd::ReduceAdd(sy);
+            az[i] = rp3d::simd::ReduceAdd(sz);
+        });
+    }
+
+    void Flock(size_t begin, size_t end, const InteractionConfig& config) {
+        const F h2 = F::Set(radius * radius), invH = F::Set(1.0f / radius), zero = F::Set(0.0f);
+        const F one = F::Set(1.0f);
+        ForEachParticle(begin, end, [&](size_t i, const Rows& rows) {
+            F xi = F::Set(x[i]), yi = F::Set(y[i]), zi = F::Set(z[i]);
+            F count = zero, sx = zero, sy = zero, sz = zero;  // Neighbors and separation
+            F cx = zero, cy = zero, cz = zero, mx = zero, my = zero, mz = zero;  // Sums of their positions and velocities
+            for (size_t row = 0; row < rows.count; ++row) {
+                for (size_t j = rows.from[row]; j < rows.to[row]; j += F::width) {
+                    auto valid = Valid(j, rows.to[row]);
+                    F xj = F::Load(&x[j]), yj = F::Load(&y[j]), zj = F::Load(&z[j]);
+                    F dx = xi - xj, dy = yi - yj, dz = zi - zj;
+                    F r2 = MulAdd(dx, dx, MulAdd(dy, dy, dz * dz));
+                    auto near = valid & (h2 > r2) & (r2 > zero);
+                    F invR = rp3d::simd::RSqrt(r2);
+                    F push = Select(near, invR - invH, zero);
+                    F in = Select(near, one, zero);
+                    count = count + in;
+                    sx = MulAdd(dx, push, sx);
+                    sy = MulAdd(dy, push, sy);
+                    sz = MulAdd(dz, push, sz);
+                    cx = MulAdd(xj, in, cx);
+                    cy = MulAdd(yj, in, cy);
+                    cz = MulAdd(zj, in, cz);
+                    mx = MulAdd(F::Load(&vx[j]), in, mx);
+                    my = MulAdd(F::Load(&vy[j]), in, my);
+                    mz = MulAdd(F::Load(&vz[j]), in, mz);
+                }
+            }
+            float neighbors = rp3d::simd::ReduceAdd(count);
+            float inv = neighbors > 0.0f ? 1.0f / neighbors : 0.0f;
+            float c = config.cohesion * inv, m = config.alignment * inv;
+            // The mean terms vanish without neighbors
+            float toward = neighbors > 0.0f ? 1.0f : 0.0f;
+            ax[i] = config.separation * rp3d::simd::ReduceAdd(sx) + c * rp3d::simd::ReduceAdd(cx)
+                - toward * (config.cohesion * x[i] + config.alignment * vx[i]) + m * rp3d::simd::ReduceAdd(mx);
+            ay[i] = config.separation * rp3d::simd::ReduceAdd(sy) + c * rp3d::simd::ReduceAdd(cy)
+                - toward * (config.cohesion * y[i] + config.alignment * vy[i]) + m * rp3d::simd::ReduceAdd(my);
+            az[i] = config.separation * rp3d::simd::ReduceAdd(sz) + c * rp3d::simd::ReduceAdd(cz)
+                - toward * (config.cohesion * z[i] + config.alignment * vz[i]) + m * rp3d::simd::ReduceAdd(mz);
+        });
+    }
+
+    void Scatter(ParticleStore& s, size_t begin, size_t end, float dt) const {
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t k = index[i];
+            float dx = ax[i] * dt, dy = ay[i] * dt, dz = az[i] * dt;
+            if (s.IsCompact()) {
+                s.packed.vx[k] = rp3d::simd::FloatToHalf(vx[i] + dx);
+                s.packed.vy[k] = rp3d::simd::FloatToHalf(vy[i] + dy);
+                s.packed.vz[k] = rp3d::simd::FloatToHalf(vz[i] + dz);
+            }
+            else {
+                s.vx[k] = vx[i] + dx;
+                s.vy[k] = vy[i] + dy;
+                s.vz[k] = vz[i] + dz;
+            }
+        }
+    }
+};
+
+// Compute-shader simulation of an emitter (OpenGL 4.3). Particle state lives in a shader storage buffer
+// that is updated and drawn in place, the CPU only uploads per-frame uniforms.
+// Slots are not compacted: a slot is free when age > ttl, and free slots take new particles.
+class GpuParticleBackend {
+public:
+    // Needs OpenGL 4.3 and glMemoryBarrier, and logs why an emitter falls back to the CPU otherwise
+    static bool Available() {
+        if (rlGetVersion() != RL_OPENGL_43) {
+            TraceLog(LOG_WARNING, "RP3D: GPU emitters need OpenGL 4.3, simulating on the CPU");
+            return false;
+        }
+#if !defined(RP3D_GPU_MEMORY_BARRIER)
+        if (BarrierProc() == nullptr) {
+            TraceLog(LOG_WARNING, "RP3D: glMemoryBarrier not found, GPU emitters simulate on the CPU");
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    GpuParticleBackend(size_t capacity, const ColorGradient& colors)
+        : capacity(static_cast<unsigned int>(capacity)), colors(colors) {}
+
+    GpuParticleBackend(const GpuParticleBackend&) = delete;
+    GpuParticleBackend& operator=(const GpuParticleBackend&) = delete;
+
+    void Unload() {
+        if (particleBuffer != 0) {
+            rlUnloadShaderBuffer(particleBuffer);
+            rlUnloadShaderBuffer(counterBuffers[0]);
+            rlUnloadShaderBuffer(counterBuffers[1]);
+            rlUnloadShaderBuffer(gradientBuffer);
+            particleBuffer = 0;
+        }
+    }
+
+    // Runs one simulation step that also spawns up to `spawnCount` particles into free slots.
+    // Returns the live count of the previous step, readback of the current one would stall the pipeline.
+    unsigned long Update(float dt, size_t spawnCount, const EmitterConfig& cfg, RandomGenerator& rng) {
+        if (particleBuffer == 0) Load();
+        const Programs& programs = GetPrograms();
+
+        // The previous step was submitted a frame ago, its counters are ready without a stall
+        unsigned int current = frame & 1u, previous = current ^ 1u;
+        unsigned int counters[4] = { 0, 0, 0, 0 };  // budget, spawned, alive, highest live slot + 1
+        if (frame++ > 0) {
+            rlReadShaderBuffer(counterBuffers[previous], counters, sizeof(counters), 0);
+            lastAlive = counters[2];
+            usedSlots = counters[3];
+        }
+
+        // Particles spawn below usedSlots + spawnCount, where at least spawnCount slots are free, so no
+        // live slot lies past that after this step and the draw stops there
+        drawSlots = static_cast<unsigned int>(std::min<size_t>(capacity, usedSlots + spawnCount));
+        counters[0] = static_cast<unsigned int>(spawnCount);
+        counters[1] = counters[2] = counters[3] = 0;
+        rlUpdateShaderBuffer(counterBuffers[current], counters, sizeof(counters), 0);
+
+        const Locations& loc = programs.compute;
+        int seed = static_cast<int>(rng.NextUInt() >> 1);
+        int collision = cfg.collision ? 1 : 0;
+        int slots = static_cast<int>(capacity), spawnLimit = static_cast<int>(drawSlots);
+        float ranges[6][2] = {
+            { cfg.directionAngle.min * DEG2RAD, cfg.directionAngle.max * DEG2RAD },
+            { cfg.velocityAngle.min * DEG2RAD, cfg.velocityAngle.max * DEG2RAD },
+            { cfg.velocity.min, cfg.velocity.max },
+            { cfg.offset.min, cfg.offset.max },
+            { cfg.originAcceleration.min, cfg.originAcceleration.max },
+            { cfg.age.min, cfg.age.max }
+        };
+
+        rlEnableShader(programs.computeProgram);
+        rlSetUniform(loc.dt, &dt, RL_SHADER_UNIFORM_FLOAT, 1);
+        rlSetUniform(loc.gravity, &cfg.gravity, RL_SHADER_UNIFORM_FLOAT, 1);
+        rlSetUniform(loc.origin, &cfg.origin, RL_SHADER_UNIFORM_VEC3, 1);
+        rlSetUniform(loc.externalAcceleration, &cfg.externalAcceleration, RL_SHADER_UNIFORM_VEC3, 1);
+        rlSetUniform(loc.collision, &collision, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(loc.capacity, &slots, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(loc.spawnLimit, &spawnLimit, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(loc.seed, &seed, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(loc.ranges, ranges, RL_SHADER_UNIFORM_VEC2, 6);
+        rlBindShaderBuffer(particleBuffer, 0);
+        rlBindShaderBuffer(counterBuffers[current], 1);
+        rlComputeShaderDispatch((capacity + groupSize - 1) / groupSize, 1, 1);
+        rlDisableShader();
+        Barrier();
+        return lastAlive;
+    }
+
+    // Draws the slots up to the highest one this step may have used as instances, the vertex shader
+    // collapses free slots to a point
+    void Draw(const EmitterConfig& cfg) const {
+        if (particleBuffer == 0) return;
+        const Programs& programs = GetPrograms();
+        const Shader& shader = programs.render;
+
+        rlDrawRenderBatchActive();
+        rlEnableShader(shader.id);
+        Matrix mvp = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+        rlSetUniformMatrix(shader.locs[SHADER_LOC_MATRIX_MVP], mvp);
+        rlBindShaderBuffer(particleBuffer, 0);
+        rlBindShaderBuffer(gradientBuffer, 2);
+
+        for (int i = 0; i < cfg.model.meshCount; ++i) {
+            const Mesh& mesh = cfg.model.meshes[i];
+            const Material& material = cfg.model.materials[cfg.model.meshMaterial[i]];
+            Vector4 diffuse = ColorNormalize(material.maps[MATERIAL_MAP_DIFFUSE].color);
+            rlSetUniform(shader.locs[SHADER_LOC_COLOR_DIFFUSE], &diffuse, RL_SHADER_UNIFORM_VEC4, 1);
+            rlActiveTextureSlot(0);
+            rlEnableTexture(material.maps[MATERIAL_MAP_DIFFUSE].texture.id);
+
+            rlEnableVertexArray(mesh.vaoId);
+            if (mesh.indices != nullptr) {
+                rlDrawVertexArrayElementsInstanced(0, mesh.triangleCount * 3, nullptr, static_cast<int>(drawSlots));
+            }
+            else {
+                rlDrawVertexArrayInstanced(0, mesh.vertexCount, static_cast<int>(drawSlots));
+            }
+            rlDisableVertexArray();
+        }
+        rlDisableTexture();
+        rlDisableShader();
+    }
+
+private:
+    static constexpr unsigned int groupSize = 256;
+    static constexpr size_t floatsPerParticle = 16;  // Matches the GLSL Particle struct
+
+    struct Locations {
+        int dt, gravity, origin, externalAcceleration, collision, capacity, spawnLimit, seed, ranges;
+    };
+
+    struct Programs {
+        unsigned int computeProgram;
+        Locations compute;
+        Shader render;
+    };
+
+    unsigned int capacity;
+    unsigned int particleBuffer = 0;
+    unsigned int counterBuffers[2] = { 0, 0 };
+    unsigned int gradientBuffer = 0;
+    ColorGradient colors;
+    unsigned int frame = 0;
+    unsigned long lastAlive = 0;
+    unsigned int usedSlots = 0;  // Highest live slot + 1 after the previous step
+    unsigned int drawSlots = 0;  // Bound on the live slots after the current one
+
+    static Vector4 ColorNormalize(Color c) {
+        return { c.r / 255.0f, c.g / 255.0f, c.b / 255.0f, c.a / 255.0f };
+    }
+
+    // Orders the draw and the counter readback after the compute pass. rlgl does not expose
+    // glMemoryBarrier, so it is looked up through the platform's GL loader, or called through the
+    // application's own when it defines RP3D_GPU_MEMORY_BARRIER().
+    static void Barrier() {
+#if defined(RP3D_GPU_MEMORY_BARRIER)
+        RP3D_GPU_MEMORY_BARRIER();
+#else
+        constexpr unsigned int shaderStorageBarrier = 0x2000, bufferUpdateBarrier = 0x200;  // GL_*_BARRIER_BIT
+        BarrierProc()(shaderStorageBarrier | bufferUpdateBarrier);
+#endif
+    }
+
+    using MemoryBarrierProc = void (*)(unsigned int barriers);
+
+    // Looked up again until a context provides it, the loaders return null before InitWindow
+    static MemoryBarrierProc BarrierProc() {
+        static std::atomic<MemoryBarrierProc> proc{ nullptr };
+        MemoryBarrierProc p = proc.load(std::memory_order_acquire);
+        if (p == nullptr) {
+            p = reinterpret_cast<MemoryBarrierProc>(LoadProc("glMemoryBarrier"));
+            proc.store(p, std::memory_order_release);
+        }
+        return p;
+    }
+
+    static void* LoadProc(const char* name) {
+#if defined(_WIN64)
+        return wglGetProcAddress(name);
+#elif defined(__unix__)
+        using GetProcAddress = void* (*)(const char* name);
+        for (const char* loader : { "glXGetProcAddressARB", "eglGetProcAddress" }) {
+            auto get = reinterpret_cast<GetProcAddress>(dlsym(RTLD_DEFAULT, loader));
+            if (void* p = get ? get(name) : nullptr) return p;
+        }
+        return dlsym(RTLD_DEFAULT, name);
+#else
+        (void)name;  // No OpenGL 4.3 here
+        return nullptr;
+#endif
+    }
+
+    void Load() {
+        // Every slot starts free: age 0, ttl -1
+        std::vector<float> initial(capacity * floatsPerParticle, 0.0f);
+        for (size_t i = 0; i < capacity; ++i) {
+            initial[i * floatsPerParticle + 7] = -1.0f;
+        }
+        particleBuffer = rlLoadShaderBuffer(static_cast<unsigned int>(initial.size() * sizeof(float)), initial.data(), RL_DYNAMIC_COPY);
+        unsigned int zero[4] = { 0, 0, 0, 0 };
+        counterBuffers[0] = rlLoadShaderBuffer(sizeof(zero), zero, RL_DYNAMIC_COPY);
+        counterBuffers[1] = rlLoadShaderBuffer(sizeof(zero), zero, RL_DYNAMIC_COPY);
+        gradientBuffer = rlLoadShaderBuffer(ColorGradient::size * sizeof(Color), colors.Data(), RL_DYNAMIC_COPY);
+        frame = 0;
+        usedSlots = drawSlots = 0;
+    }
+
+    static const Programs& GetPrograms() {
+        static Programs programs = LoadPrograms();
+        return programs;
+    }
+
+    static Programs LoadPrograms() {
+        static const char* common = R"(
+struct Particle {
+    vec4 position;  // xyz, w = age
+    vec4 velocity;  // xyz, w = ttl
+    vec4 origin;    // xyz, w = originAcceleration
+    vec4 misc;      // x = scale
+};
+)";
+        static const char* compute = R"(
+layout(local_size_x = 256) in;
+layout(std430, binding = 0) buffer Particles { Particle particles[]; };
+layout(std430, binding = 1) buffer Counters { uint budget; uint spawned; uint alive; uint used; };
+
+uniform float dt;
+uniform float gravity;
+uniform vec3 origin;
+uniform vec3 externalAcceleration;
+uniform int collision;
+uniform int capacity;
+uniform int spawnLimit;  // Free slots at or above it stay free, which bounds the draw
+uniform int seed;
+uniform vec2 ranges[6];  // theta, phi (radians), velocity, offset, originAcceleration, ttl
+
+uint Hash(uint x) {
+    x ^= x >> 16; x *= 0x7feb352du;
+    x ^= x >> 15; x *= 0x846ca68bu;
+    return x ^ (x >> 16);
+}
+
+float Random(inout uint state, int range) {
+    state = Hash(state);
+    return mix(ranges[range].x, ranges[range].y, float(state >> 8) * (1.0 / 16777216.0));
+}
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= uint(capacity)) return;
+    Particle p = particles[i];
+
+    if (p.position.w > p.velocity.w) {
+        if (i >= uint(spawnLimit) || atomicAdd(spawned, 1u) >= budget) return;
+        uint state = Hash(i ^ Hash(uint(seed)));
+        float theta = Random(state, 0), phi = Random(state, 1);
+        vec3 dir = vec3(sin(phi) * cos(theta), cos(phi), sin(phi) * sin(theta));
+        p.velocity = vec4(dir * Random(state, 2), 0.0);
+        p.position = vec4(origin + dir * Random(state, 3), 0.0);
+        p.origin = vec4(origin, Random(state, 4));
+        p.velocity.w = Random(state, 5);
+    }
+
+    p.position.w += dt;
+    if (p.position.w <= p.velocity.w) {
+        vec3 v = p.velocity.xyz;
+        v.y -= gravity * dt;
+        vec3 toOrigin = p.origin.xyz - p.position.xyz;
+        float len = length(toOrigin);
+        v += (len > 0.0 ? toOrigin / len : vec3(0.0)) * p.origin.w * dt;
+        v += externalAcceleration * dt;
+        p.position.xyz += v * dt;
+        if (collision != 0 && p.position.y <= -1.0) {
+            p.position.y = -1.0;
+            v.y *= -0.5;
+        }
+        p.velocity.xyz = v;
+        p.misc.x = 1.0 / (distance(p.position.xyz, origin) * 0.1 + 1.0);
+        atomicAdd(alive, 1u);
+        atomicMax(used, i + 1u);
+    }
+    particles[i] = p;
+}
+)";
+        static const char* vertex = R"(
+in vec3 vertexPosition;
+in vec2 vertexTexCoord;
+layout(std430, binding = 0) readonly buffer Particles { Particle particles[]; };
+layout(std430, binding = 2) readonly buffer Gradient { uint gradient[256]; };  // ColorGradient table, RGBA8
+uniform mat4 mvp;
+out vec2 fragTexCoord;
+out vec4 fragColor;
+void main() {
+    Particle p = particles[gl_InstanceID];
+    bool live = p.position.w <= p.velocity.w;
+    fragTexCoord = vertexTexCoord;
+    float life = live ? p.position.w / p.velocity.w : 0.0;
+    fragColor = unpackUnorm4x8(gradient[uint(min(life, 1.0) * 255.0 + 0.5)]);
+    gl_Position = mvp * vec4(vertexPosition * (live ? p.misc.x : 0.0) + p.position.xyz, 1.0);
+}
+)";
+        static const char* fragment = R"(#version 430
+in vec2 fragTexCoord;
+in vec4 fragColor;
+uniform sampler2D texture0;
+uniform vec4 colDiffuse;
+out vec4 finalColor;
+void main() {
+    finalColor = texture(texture0, fragTexCoord) * colDiffuse * fragColor;
+}
+)";
+        std::string header = "#version 430\n";
+        std::string computeCode = header + common + compute;
+        std::string vertexCode = header + common + vertex;
+
+        Programs programs{};
+        unsigned int computeShader = rlCompileShader(computeCode.c_str(), RL_COMPUTE_SHADER);
+        programs.computeProgram = rlLoadComputeShaderProgram(computeShader);
+        unsigned int id = programs.computeProgram;
+        programs.compute = {
+            rlGetLocationUniform(id, "dt"), rlGetLocationUniform(id, "gravity"), rlGetLocationUniform(id, "origin"),
+            rlGetLocationUniform(id, "externalAcceleration"), rlGetLocationUniform(id, "collision"),
+            rlGetLocationUniform(id, "capacity"), rlGetLocationUniform(id, "spawnLimit"), rlGetLocationUniform(id, "seed"),
+            rlGetLocationUniform(id, "ranges")
+        };
+        programs.render = LoadShaderFromMemory(vertexCode.c_str(), fragment);
+        return programs;
+    }
+};
+
+// Instance transforms and colors gathered from one or more emitters, drawn with one
+// DrawMeshInstanced call per mesh and the InstancingShader
+class InstanceBatch {
+public:
+    std::vector<Matrix> transforms;
+    std::vector<Color> colors;
+
+    InstanceBatch() = default;
+    InstanceBatch(const InstanceBatch&) = delete;
+    InstanceBatch& operator=(const InstanceBatch&) = delete;
+
+    void Clear() {
+        transforms.clear();
+        colors.clear();
+    }
+
+    void Reserve(size_t count) {
+        transforms.reserve(count);
+        colors.reserve(count);
+    }
+
+    void Unload() {
+        if (colorBuffer != 0) {
+            rlUnloadVertexBuffer(colorBuffer);
+            colorBuffer = 0;
+            bufferCapacity = 0;
+        }
+    }
+
+    void Draw(const Model& model) {
+        if (transforms.empty()) return;
+
+        int instances = static_cast<int>(colors.size());
+        if (colors.size() > bufferCapacity) {
+            // Sized for the vector's capacity, later frames only stream the gathered range
+            Unload();
+            bufferCapacity = colors.capacity();
+            colorBuffer = rlLoadVertexBuffer(nullptr, static_cast<int>(bufferCapacity * sizeof(Color)), true);
+        }
+        rlUpdateVertexBuffer(colorBuffer, colors.data(), instances * static_cast<int>(sizeof(Color)), 0);
+
+        for (int i = 0; i < model.meshCount; ++i) {
+            const Mesh& mesh = model.meshes[i];
+            Material material = model.materials[model.meshMaterial[i]];
+            material.shader = InstancingShader::Get();
+
+            // Attach the color stream to the mesh VAO for the duration of the instanced call
+            rlEnableVertexArray(mesh.vaoId);
+            rlEnableVertexBuffer(colorBuffer);
+            rlSetVertexAttribute(InstancingShader::colorLocation, 4, RL_UNSIGNED_BYTE, true, 0, 0);
+            rlEnableVertexAttribute(InstancingShader::colorLocation);
+            rlSetVertexAttributeDivisor(InstancingShader::colorLocation, 1);
+            rlDisableVertexBuffer();
+            rlDisableVertexArray();
+
+            DrawMeshInstanced(mesh, material, transforms.data(), instances);
+
+            rlEnableVertexArray(mesh.vaoId);
+            rlDisableVertexAttribute(InstancingShader::colorLocation);
+            rlDisableVertexArray();
+        }
+    }
+
+private:
+    unsigned int colorBuffer = 0;
+    size_t bufferCapacity = 0;
+};
+
+// Back-to-front draw order from an LSD radix sort on 16-bit view depth keys. The keys are quantized
+// over the depth range of the previous frame, taken from its key histogram, so a separate min/max
+// pass only runs when particles leave that range. Each 8-bit pass is skipped when all keys share
+// that byte.
+class DepthSorter {
+public:
+    // Orders `n` particles farthest first along the view direction of `view`. They are the indices
+    // listed in `subset`, or the first `n` slots when it is null. Returns the ordered indices.
+    const uint32_t* Sort(const ParticleStore& s, const Matrix& view, const uint32_t* subset, size_t n) {
+        if (keys[0].size() < s.Capacity()) {
+            for (int b = 0; b < 2; ++b) {
+                keys[b].resize(s.Capacity());
+                indices[b].resize(s.Capacity());
+            }
+        }
+        if (n == 0) return indices[0].data();
+
+        // View space z, the camera looks down -z so the farthest particle has the smallest depth
+        const float zx = view.m2, zy = view.m6, zz = view.m10, zw = view.m14;
+        const float *px = s.px, *py = s.py, *pz = s.pz;
+        auto depth = [=](size_t j) {
+            size_t i = subset ? subset[j] : j;
+            return zx * px[i] + zy * py[i] + zz * pz[i] + zw;
+        };
+        if (!hasRange) {
+            nearest = farthest = depth(0);
+            for (size_t i = 1; i < n; ++i) {
+                nearest = std::max(nearest, depth(i));
+                farthest = std::min(farthest, depth(i));
+            }
+            float margin = std::max((nearest - farthest) * 0.0625f, 1e-3f);
+            nearest += margin;
+            farthest -= margin;
+            hasRange = true;
+        }
+
+        float low = farthest, scale = 65535.0f / (nearest - farthest);
+        uint16_t* k = keys[0].data();
+        for (size_t i = 0; i < n; ++i) {
+            float q = std::min(std::max((depth(i) - low) * scale, 0.0f), 65535.0f);
+            k[i] = static_cast<uint16_t>(static_cast<int>(q));
+        }
+        // Histograms in their own loop so the key loop above vectorizes
+        uint32_t counts[2][256] = {};
+        for (size_t i = 0; i < n; ++i) {
+            ++counts[0][k[i] & 0xFF];
+            ++counts[1][k[i] >> 8];
+        }
+
+        // Next frame's range is the span of occupied high-byte buckets plus a margin. Keys in the end
+        // buckets may have been clamped, then the range is measured again.
+        size_t first = 0, last = 255;
+        while (counts[1][first] == 0) ++first;
+        while (counts[1][last] == 0) --last;
+        if (first == 0 || last == 255) {
+            hasRange = false;
+        }
+        else {
+            float bucket = 256.0f / scale;
+            float newFarthest = low + first * bucket, newNearest = low + (last + 1) * bucket;
+            float margin = std::max((newNearest - newFarthest) * 0.0625f, 1e-3f);
+            nearest = newNearest + margin;
+            farthest = newFarthest - margin;
+        }
+
+        // Stable passes, so particles with equal keys keep their storage order and do not flicker
+        int src = 0;
+        const uint32_t* input = subset;  // Null while the order is still the identity
+        for (int pass = 0; pass < 2; ++pass) {
+            unsigned shift = pass * 8;
+            if (counts[pass][(keys[src][0] >> shift) & 0xFF] == n) continue;
+
+            uint32_t offsets[256];
+            uint32_t sum = 0;
+            for (int b = 0; b < 256; ++b) {
+                offsets[b] = sum;
+                sum += counts[pass][b];
+            }
+            int dst = src ^ 1;
+            const uint16_t* inKeys = keys[src].data();
+            uint16_t* outKeys = keys[dst].data();
+            uint32_t* outIndices = indices[dst].data();
+            for (size_t i = 0; i < n; ++i) {
+                uint32_t slot = offsets[(inKeys[i] >> shift) & 0xFF]++;
+                outKeys[slot] = inKeys[i];
+                outIndices[slot] = input ? input[i] : static_cast<uint32_t>(i);
+            }
+            input = outIndices;
+            src = dst;
+        }
+        if (!input) {
+            for (size_t i = 0; i < n; ++i) {
+                indices[src][i] = static_cast<uint32_t>(i);
+            }
+            input = indices[src].data();
+        }
+        return input;
+    }
+
+private:
+    std::vector<uint16_t> keys[2];
+    std::vector<uint32_t> indices[2];
+    float nearest = 0.0f, farthest = 0.0f;  // Depth range of the previous frame
+    bool hasRange = false;
+};
+
+// Expands particles into camera-facing quads on the CPU and streams them through a ring of vertex
+// buffers, so the buffer written this frame is not the one the GPU may still be reading. The quads
+// are drawn with the shader, texture and color of the model's first material in one call.
+class BillboardRenderer {
+public:
+    static constexpr size_t bufferCount = 3;
+    static constexpr size_t verticesPerQuad = 6;  // Two triangles, rlgl only draws 16-bit indices
+
+    struct Vertex {
+        float x, y, z;
+        float u, v;
+        Color color;
+    };
+
+    BillboardRenderer() = default;
+    BillboardRenderer(const BillboardRenderer&) = delete;
+    BillboardRenderer& operator=(const BillboardRenderer&) = delete;
+
+    void Unload() {
+        for (Buffer& buffer : ring) {
+            Unload(buffer);
+        }
+    }
+
+    // `view` gives the camera axes, the vertices are written in world space
+    // Draws `count` particles, `order` lists their indices in sequence or is null for the first `count` slots
+    void Draw(const ParticleStore& particles, const ColorGradient& colors, const Matrix& view, float size,
+              const Material& material, const uint32_t* order, size_t count) {
+        if (count == 0) return;
+        // Sized for the store's capacity, and sized again when a growing store outgrows them
+        if (vertices.size() < particles.Capacity() * verticesPerQuad) {
+            vertices.resize(particles.Capacity() * verticesPerQuad);
+        }
+        Expand(particles, colors, view, size * 0.5f, order, count);
+
+        Buffer& buffer = ring[frame++ % bufferCount];
+        if (buffer.capacity < particles.Capacity()) {
+            Unload(buffer);
+            buffer = LoadBuffer(material.shader, particles.Capacity());
+        }
+        int vertexCount = static_cast<int>(count * verticesPerQuad);
+        rlUpdateVertexBuffer(buffer.vbo, vertices.data(), vertexCount * static_cast<int>(sizeof(Vertex)), 0);
+
+        rlDrawRenderBatchActive();  // Keep the order of anything raylib batched before this emitter
+        const Shader& shader = material.shader;
+        rlEnableShader(shader.id);
+        Matrix mvp = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+        rlSetUniformMatrix(shader.locs[SHADER_LOC_MATRIX_MVP], mvp);
+        Vector4 diffuse = ColorNormalize(material.maps[MATERIAL_MAP_DIFFUSE].color);
+        rlSetUniform(shader.locs[SHADER_LOC_COLOR_DIFFUSE], &diffuse, RL_SHADER_UNIFORM_VEC4, 1);
+        rlActiveTextureSlot(0);
+        rlEnableTexture(material.maps[MATERIAL_MAP_DIFFUSE].texture.id);
+
+        rlEnableVertexArray(buffer.vao);
+        rlDrawVertexArray(0, vertexCount);
+        rlDisableVertexArray();
+
+        rlDisableTexture();
+        rlDisableShader();
+    }
+
+private:
+    struct Buffer {
+        unsigned int vao = 0, vbo = 0;
+        size_t capacity = 0;  // Quads the vertex buffer holds
+    };
+
+    std::array<Buffer, bufferCount> ring;
+    std::vector<Vertex> vertices;
+    size_t frame = 0;
+
+    void Expand(const ParticleStore& s, const ColorGradient& colors, const Matrix& view, float halfSize,
+                const uint32_t* order, size_t count) {
+        // Rows of the view rotation are the camera axes in world space
+        Vector3 right = { view.m0, view.m4, view.m8 };
+        Vector3 up = { view.m1, view.m5, view.m9 };
+        Vertex* out = vertices.data();
+        for (size_t k = 0; k < count; ++k, out += verticesPerQuad) {
+            size_t i = order ? order[k] : k;
+            float h = s.Scale(i) * halfSize;
+            float rx = right.x * h, ry = right.y * h, rz = right.z * h;
+            float ux = up.x * h, uy = up.y * h, uz = up.z * h;
+            Vector3 p = s.DrawPosition(i);
+            float x = p.x, y = p.y, z = p.z;
+            Color c = colors.Sample(s.Life(i));
+
+            // Counter-clockwise seen from the camera, texture v runs top to bottom
+            Vertex bottomLeft = { x - rx - ux, y - ry - uy, z - rz - uz, 0.0f, 1.0f, c };
+            Vertex bottomRight = { x + rx - ux, y + ry - uy, z + rz - uz, 1.0f, 1.0f, c };
+            Vertex topRight = { x + rx + ux, y + ry + uy, z + rz + uz, 1.0f, 0.0f, c };
+            Vertex topLeft = { x - rx + ux, y - ry + uy, z - rz + uz, 0.0f, 0.0f, c };
+            out[0] = bottomLeft;
+            out[1] = bottomRight;
+            out[2] = topRight;
+            out[3] = bottomLeft;
+            out[4] = topRight;
+            out[5] = topLeft;
+        }
+    }
+
+    static void Unload(Buffer& buffer) {
+        if (buffer.vao != 0) {
+            rlUnloadVertexArray(buffer.vao);
+            rlUnloadVertexBuffer(buffer.vbo);
+            buffer = Buffer{};
+        }
+    }
+
+    static Buffer LoadBuffer(const Shader& shader, size_t capacity) {
+        Buffer buffer;
+        buffer.capacity = capacity;
+        buffer.vao = rlLoadVertexArray();
+        rlEnableVertexArray(buffer.vao);
+        buffer.vbo = rlLoadVertexBuffer(nullptr, static_cast<int>(capacity * verticesPerQuad * sizeof(Vertex)), true);
+        constexpr int stride = sizeof(Vertex);
+        SetAttribute(shader.locs[SHADER_LOC_VERTEX_POSITION], 3, RL_FLOAT, false, stride, offsetof(Vertex, x));
+        SetAttribute(shader.locs[SHADER_LOC_VERTEX_TEXCOORD01], 2, RL_FLOAT, false, stride, offsetof(Vertex, u));
+        SetAttribute(shader.locs[SHADER_LOC_VERTEX_COLOR], 4, RL_UNSIGNED_BYTE, true, stride, offsetof(Vertex, color));
+        rlDisableVertexArray();
+        return buffer;
+    }
+
+    static void SetAttribute(int location, int components, int type, bool normalized, int stride, size_t offset) {
+        if (location < 0) return;  // Attribute unused by the shader
+#if defined(RAYLIB_VERSION_MAJOR) && (RAYLIB_VERSION_MAJOR > 5 || (RAYLIB_VERSION_MAJOR == 5 && RAYLIB_VERSION_MINOR >= 5))
+        rlSetVertexAttribute(static_cast<unsigned int>(location), components, type, normalized, stride, static_cast<int>(offset));
+#else
+        // rlgl before raylib 5.5 takes the offset as a pointer
+        rlSetVertexAttribute(static_cast<unsigned int>(location), components, type, normalized, stride, reinterpret_cast<const void*>(offset));
+#endif
+        rlEnableVertexAttribute(static_cast<unsigned int>(location));
+    }
+};
+
+// Level of detail of one emitter, filled in by ParticleSystem from its LodPolicy or set by hand
+struct EmitterLod {
+    float emissionScale = 1.0f;  // Multiplies emissionRate
+    unsigned tickInterval = 1;  // Simulate on every Nth Update, the skipped time is caught up in sub-steps
+    unsigned tickPhase = 0;  // Offset within the interval, spreads throttled emitters over frames
+    bool paused = false;  // No simulation at all, the particles keep their state
+    size_t particleLimit = std::numeric_limits<size_t>::max();  // Live particles allowed, from the global budget
+};
+
+// Three draw-side copies of an emitter's particles, for a pipelined ParticleSystem. The simulation
+// fills the back slot and publishes it by swapping it with the ready slot. The renderer swaps the
+// ready slot with its front slot when a newer one was published. Both swaps are a single atomic
+// exchange, so neither side ever waits for the other.
+class SnapshotBuffer {
+public:
+    struct Slot {
+        ParticleStore particles;
+        BoundingBox bounds;
+    };
+
+    // Each slot grows like the store it copies, up to `maxCapacity`, and keeps its pages afterwards
+    SnapshotBuffer(size_t capacity, size_t maxCapacity, std::pmr::memory_resource* memory)
+        : slots{ Make(capacity, maxCapacity, memory), Make(capacity, maxCapacity, memory), Make(capacity, maxCapacity, memory) } {}
+
+    // Simulation side
+    Slot& Back() { return slots[back]; }
+    void Publish() {
+        back = ready.exchange(back | fresh, std::memory_order_acq_rel) & ~fresh;
+    }
+
+    // Render side. Returns false when nothing newer than the front slot was published.
+    bool Acquire() {
+        if ((ready.load(std::memory_order_relaxed) & fresh) == 0) return false;
+        front = ready.exchange(front, std::memory_order_acq_rel) & ~fresh;
+        return true;
+    }
+    const Slot& Front() const { return slots[front]; }
+
+    // Empties every slot. Only while neither side is using the buffer.
+    void Reset() {
+        for (Slot& slot : slots) {
+            slot.particles.Clear();
+            slot.bounds = ParticleKernel::EmptyBounds();
+        }
+        ready.store(ready.load() & ~fresh);
+    }
+
+private:
+    static constexpr unsigned fresh = 4;  // Set on the ready index when it holds an unread slot
+
+    Slot slots[3];
+    unsigned front = 0, back = 1;
+    std::atomic<unsigned> ready{ 2 };
+
+    static Slot Make(size_t capacity, size_t maxCapacity, std::pmr::memory_resource* memory) {
+        return { ParticleStore(capacity, memory, ParticleStore::SnapshotLayout{}, maxCapacity), ParticleKernel::EmptyBounds() };
+    }
+};
+
+// Byte encoding of the states saved by Emitter::SaveState and ParticleSystem::SaveState. Values are
+// copied as they sit in memory, so a state restores on the same platform and build.
+struct StateBlob {
+    static void Put(std::vector<std::byte>& out, const void* data, size_t bytes) {
+        const std::byte* first = static_cast<const std::byte*>(data);
+        out.insert(out.end(), first, first + bytes);
+    }
+    template <class T>
+    static void Put(std::vector<std::byte>& out, const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        Put(out, &value, sizeof(T));
+    }
+
+    // False, leaving `in` alone, when fewer than sizeof(T) bytes are left
+    template <class T>
+    static bool Get(std::span<const std::byte>& in, T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (in.size() < sizeof(T)) return false;
+        std::memcpy(&value, in.data(), sizeof(T));
+        in = in.subspan(sizeof(T));
+        return true;
+    }
+};
+
+// What one emitter did in its last Update and its last draw. The counters are always kept, the
+// timings only once stats are enabled. GPU emitters only count what they were asked to spawn.
+struct EmitterStats {
+    unsigned long live = 0;
+    size_t spawned = 0;  // Bursts since the previous Update included, 0 when LOD skipped the tick
+    size_t expired = 0;
+    size_t dropped = 0;  // Particles that found no free slot, because of the capacity or the LOD budget
+    size_t killed = 0;  // Particles OverflowPolicy::KillOldest removed to make room
+    size_t drawn = 0;  // Particles submitted by the last draw, after culling
+    uint64_t spawnNs = 0;  // Spawn, bursts excluded
+    uint64_t updateNs = 0;  // Neighbor forces, update kernel and removal of the expired particles
+    uint64_t cullNs = 0;  // Frustum culling and depth sorting of the last draw
+    uint64_t drawNs = 0;  // The rest of the last draw: instance building and submission
+
+    // Live particles over the capacity, 1 when every slot is taken. Pass MaxCapacity for a growing emitter.
+    float Saturation(size_t capacity) const {
+        return capacity > 0 ? static_cast<float>(live) / static_cast<float>(capacity) : 0.0f;
+    }
+};
+
+// Particle emitter class, managing the creation, updating, and drawing of particles
+class Emitter {
+public:
+    // Particle arrays are allocated from `memory`, ParticleSystem::Emplace passes its arena
+    Emitter(EmitterConfig cfg, std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : config(std::move(cfg)), mustEmit(0), isEmitting(false), colors(config),
+          gpu(config.backend == SimulationBackend::GPU && GpuParticleBackend::Available()
+              ? std::make_unique<GpuParticleBackend>(config.capacity, colors) : nullptr),
+          particles(gpu ? 0 : config.capacity, memory, config.layout, gpu ? 0 : GrowthLimit(config)),
+          expired(gpu ? 0 : config.capacity, memory),
+          memory(memory),
+          rng(config.seed != 0 ? config.seed : RandomGenerator::UniqueSeed()),
+          bounds(ParticleKernel::EmptyBounds()), visible(memory) {
+        if (config.sharedModel) {
+            config.model = *config.sharedModel;
+        }
+        particleRadius = ParticleRadius(config);
+        config.direction = Vector3Normalize(config.direction);
+        particles.origin = particles.offsetOrigin = config.origin;
+        particles.scaleByDistance = config.scaleByDistance;
+        if (config.updateMode == UpdateMode::Parallel) {
+            chunks.reserve(config.capacity / minChunkSize + 1);
+        }
+        if (config.drawMode == DrawMode::Instanced) {
+            instances.Reserve(config.capacity);
+        }
+        if (config.cullParticles && !gpu) {
+            visible.resize(config.capacity);
+        }
+    }
+
+    // Releases GPU buffers owned by the emitter, call before closing the window
+    void Unload() {
+        instances.Unload();
+        billboards.Unload();
+        if (gpu) {
+            gpu->Unload();
+        }
+    }
+    void SetOrigin(const Vector3& newOrigin) {
+        config.origin = newOrigin;
+    }
+    // Pool used by UpdateMode::Parallel, ThreadPool::Default() when not set
+    void SetThreadPool(ThreadPool* threads) {
+        pool = threads;
+    }
+    // Restarts the random sequence used for spawning, for deterministic replays
+    void Seed(uint64_t seed) {
+        rng.Seed(seed);
+    }
+    void Start() {
+        isEmitting = true;
+        emissionTime = 0.0f;
+    }
+    void Stop() { isEmitting = false; }
+    bool IsEmitting() const { return isEmitting; }
+
+    // No emission left and no live particle, the emitter has nothing more to show
+    bool IsFinished() const {
+        return !isEmitting && gpuBurst == 0 && LiveCount() == 0;
+    }
+
+    // Clears the emission and LOD state of a finished emitter, so a pool can hand it out again
+    void Restart(const Vector3& newOrigin) {
+        config.origin = newOrigin;
+        mustEmit = 0.0f;
+        isEmitting = false;
+        bounds = ParticleKernel::EmptyBounds();
+        lod = EmitterLod{};
+        isOccluded = false;
+        pendingDt = 0.0f;
+        ticks = 0;
+        if (snapshots) {
+            snapshots->Reset();
+        }
+    }
+
+    void Burst() {
+        Spawn(static_cast<size_t>(std::max(config.burst.RandomValue(rng), 0)));
+    }
+
+    // Fast-forwards by `seconds` in coarse steps of `step`, so an effect streamed in shows up already
+    // running. Each step spreads the particles it spawns over its length, which hides the coarse
+    // steps. Neighbor forces are not stable on coarse steps, emitters with an
+    // interaction model step at most 1/30 s. Ignores LOD, runs on the calling thread for GPU emitters.
+    void Prewarm(float seconds, float step = 0.1f) {
+        step = std::max(step, 1e-3f);
+        if (config.interaction.model != InteractionModel::None) {
+            step = std::min(step, maxStep);
+        }
+        for (float left = seconds; left > 0.0f; left -= step) {
+            lastLive = Step(std::min(step, left), true);
+        }
+        pending = EmitterStats{};  // The fast-forward is not part of the next Update's counts
+    }
+
+    // Appends the simulation state to `out`: emission counters, random generator and live particles,
+    // copied array by array. A GPU emitter keeps its particles in video memory and saves the rest.
+    void SaveState(std::vector<std::byte>& out) const {
+        SavedState state;
+        std::memset(static_cast<void*>(&state), 0, sizeof(state));  // No stack bytes in the padding
+        state.bytesPerParticle = particles.BytesPerParticle();
+        state.count = particles.Size();
+        state.capacity = particles.Capacity();
+        state.peakLive = peakLive;
+        state.history = particles.prevX != nullptr;
+        state.gpuBurst = gpuBurst;
+        state.lastLive = lastLive;
+        state.rng = rng;
+        state.bounds = bounds;
+        state.origin = config.origin;
+        state.particleOrigin = particles.origin;
+        state.mustEmit = mustEmit;
+        state.emissionTime = emissionTime;
+        state.pendingDt = pendingDt;
+        state.idleTime = idleTime;
+        state.ticks = ticks;
+        state.isEmitting = isEmitting;
+        StateBlob::Put(out, state);
+        size_t offset = out.size();
+        out.resize(offset + particles.StateBytes(state.history));
+        particles.SaveState(out.data() + offset);
+    }
+
+    // Puts back a state saved by an emitter with the same layout and at least as much capacity,
+    // or as much room to grow, and moves `in` past it. A growing emitter takes the saved capacity.
+    // Returns false, changing nothing, when `in` holds no such state; with `apply` false it only checks.
+    bool RestoreState(std::span<const std::byte>& in, bool apply = true) {
+        std::span<const std::byte> rest = in;
+        SavedState state;
+        size_t room = particles.MaxCapacity() > config.capacity ? particles.MaxCapacity() : particles.Capacity();
+        if (!StateBlob::Get(rest, state) || state.bytesPerParticle != particles.BytesPerParticle()
+            || state.count > room) return false;
+        size_t bytes = state.count * (state.bytesPerParticle + (state.history ? 3 * sizeof(float) : 0));
+        if (rest.size() < bytes) return false;
+        in = rest.subspan(bytes);
+        if (!apply) return true;
+
+        bool growing = particles.MaxCapacity() > config.capacity;
+        if (growing) {
+            Grow(static_cast<size_t>(std::max(state.capacity, state.count)));
+        }
+        particles.RestoreState(rest.data(), state.count, state.history != 0);
+        if (growing) {
+            particles.Shrink(static_cast<size_t>(state.capacity));
+        }
+        gpuBurst = state.gpuBurst;
+        lastLive = state.lastLive;
+        rng = state.rng;
+        bounds = state.bounds;
+        config.origin = state.origin;
+        particles.origin = particles.offsetOrigin = state.particleOrigin;
+        mustEmit = state.mustEmit;
+        emissionTime = state.emissionTime;
+        pendingDt = state.pendingDt;
+        idleTime = state.idleTime;
+        peakLive = static_cast<size_t>(state.peakLive);
+        ticks = state.ticks;
+        isEmitting = state.isEmitting;
+        if (snapshots) {
+            snapshots->Reset();
+            PublishSnapshot();
+        }
+        return true;
+    }
+
+    // Spawns up to `count` particles in one batch and returns how many fit in the free capacity.
+    // On the GPU backend the batch is queued for the next compute pass, which drops what does not fit.
+    size_t Spawn(size_t count) {
+        size_t n = Place(count);
+        pending.dropped += count - n;
+        return n;
+    }
+
+    // Advances the emitter by `dt` and returns the live particle count. A throttled emitter only
+    // simulates on every tickInterval-th call, then catches up on the accumulated time.
+    unsigned long Update(float dt) {
+        if (lod.paused) return PublishStats();
+
+        pendingDt += dt;
+        unsigned interval = std::max(lod.tickInterval, 1u);
+        if ((ticks++ + lod.tickPhase) % interval != 0) return PublishStats();
+
+        // Sub-steps keep large catch-up steps as stable as regular frames
+        unsigned steps = std::clamp(static_cast<unsigned>(std::ceil(pendingDt / maxStep)), 1u, maxSubsteps);
+        float step = pendingDt / static_cast<float>(steps);
+        for (unsigned i = 0; i < steps; ++i) {
+            lastLive = Step(step);
+        }
+        pendingDt = 0.0f;
+        return PublishStats();
+    }
+
+    // Keeps the positions before each step, so Draw can blend them with the current ones.
+    // No effect on the GPU backend.
+    void EnableInterpolation() {
+        if (!gpu) {
+            particles.EnableHistory();
+        }
+    }
+    // Fraction of the last step that Draw shows, from 0 (previous positions) to 1 (current)
+    void SetInterpolation(float alpha) {
+        particles.alpha = alpha;
+    }
+
+    // Makes Draw read a copy of the particles taken by PublishSnapshot, so a pipelined
+    // ParticleSystem can update on another thread while the emitter is drawn. No effect on the GPU.
+    void EnableSnapshots() {
+        if (!gpu && !snapshots) {
+            snapshots = std::make_unique<SnapshotBuffer>(particles.Capacity(), particles.MaxCapacity(), memory);
+        }
+    }
+    void DisableSnapshots() {
+        snapshots.reset();
+    }
+
+    // Simulation thread: copies the positions, scales and life fractions Draw needs and publishes them
+    void PublishSnapshot() {
+        if (!snapshots) return;
+        SnapshotBuffer::Slot& slot = snapshots->Back();
+        ParticleStore& copy = slot.particles;
+        size_t n = particles.Size();
+        copy.Clear();
+        copy.Reserve(n);
+        copy.Push(n);
+        for (size_t i = 0; i < n; ++i) {
+            Vector3 p = particles.DrawPosition(i);
+            copy.px[i] = p.x;
+            copy.py[i] = p.y;
+            copy.pz[i] = p.z;
+            copy.scale[i] = particles.Scale(i);
+            copy.packed.life[i] = static_cast<uint16_t>(std::min(particles.Life(i), 1.0f) * 65535.0f + 0.5f);
+        }
+        slot.bounds = bounds;
+        snapshots->Publish();
+    }
+
+    // Render thread: switches Draw to the latest published snapshot
+    void AcquireSnapshot() {
+        if (snapshots) {
+            snapshots->Acquire();
+        }
+    }
+
+    void SetLod(const EmitterLod& level) {
+        lod = level;
+    }
+    const EmitterLod& Lod() const { return lod; }
+
+    // With `collision` set, particles bounce off these instead of the y = -1 floor. The set must be
+    // built and outlive the emitter. ParticleSystem passes its own. The GPU backend keeps the floor.
+    void SetColliders(const ColliderSet* set) {
+        colliders = set;
+    }
+
+    // Force fields applied to this emitter's particles, in the order they were added, before those of
+    // its system. Returns the affector's index. CPU emitters only.
+    template <class A>
+    size_t AddAffector(A affector) {
+        return affectors.Add(std::move(affector));
+    }
+    void ClearAffectors() {
+        affectors.Clear();
+    }
+    const AffectorList& Affectors() const { return affectors; }
+    // Affectors shared with other emitters, applied after the emitter's own. ParticleSystem passes its own.
+    void SetSharedAffectors(const AffectorList* list) {
+        sharedAffectors = list;
+    }
+
+    // Forces between neighboring particles, applied from the next update on
+    void SetInteraction(const InteractionConfig& interaction) {
+        config.interaction = interaction;
+    }
+
+    // Set by the game, for example from an occlusion query. LodPolicy::pauseOccluded stops simulating
+    // occluded emitters.
+    void SetOccluded(bool occluded) {
+        isOccluded = occluded;
+    }
+    bool IsOccluded() const { return isOccluded; }
+
+    // Times the spawn, update, cull and draw stages into Stats. ParticleSystem::SetStatsEnabled sets it.
+    void SetStatsEnabled(bool enabled) {
+        statsEnabled = enabled;
+    }
+    const EmitterStats& Stats() const { return stats; }
+
+    // True when the emitter simulates on the GPU, which has to happen on the thread owning the GL context
+    bool OnGpu() const { return gpu != nullptr; }
+
+    // Particles the emitter can hold now, and at most once OverflowPolicy::Grow has grown it. The
+    // largest is the emitter's demand when the particle budget is split.
+    size_t Capacity() const { return gpu ? config.capacity : particles.Capacity(); }
+    size_t MaxCapacity() const { return gpu ? config.capacity : particles.MaxCapacity(); }
+
+    // Gives the pages a grown emitter no longer needs back, down to `capacity` or the live count.
+    // ParticleSystem calls it when a one-shot returns to its pool.
+    void TrimCapacity() {
+        if (gpu) return;
+        particles.Shrink(std::max(config.capacity, PageRound(particles.Size())));
+        idleTime = 0.0f;
+        peakLive = particles.Size();
+    }
+
+    // Distance from `viewer` to the closest point of the bounds, and the radius of a sphere around them
+    void Extent(const Vector3& viewer, float& distance, float& radius) const {
+        if (gpu || particles.Size() == 0) {
+            distance = Vector3Distance(viewer, config.origin);
+            radius = std::max(std::abs(config.offset.min), std::abs(config.offset.max)) + particleRadius;
+            return;
+        }
+        BoundingBox box = Bounds();
+        distance = Vector3Distance(viewer, Vector3Min(Vector3Max(viewer, box.min), box.max));
+        radius = Vector3Distance(box.min, box.max) * 0.5f;
+    }
+
+    // Box holding every live particle, GPU emitters report an unbounded box
+    BoundingBox Bounds() const {
+        if (gpu) {
+            constexpr float inf = std::numeric_limits<float>::infinity();
+            return { { -inf, -inf, -inf }, { inf, inf, inf } };
+        }
+        return Grow(bounds);
+    }
+
+    // Whether any particle may show up in `frustum`, within drawDistance of `viewer` when it is set.
+    // Tests the snapshot Draw would show when snapshots are enabled.
+    bool IsVisible(const Frustum& frustum, const Vector3& viewer) const {
+        if (gpu) return true;
+        if (Drawn().Size() == 0) return false;
+        BoundingBox box = snapshots ? Grow(snapshots->Front().bounds) : Bounds();
+        if (config.drawDistance > 0.0f) {
+            Vector3 closest = Vector3Min(Vector3Max(viewer, box.min), box.max);
+            if (Vector3DistanceSqr(viewer, closest) > config.drawDistance * config.drawDistance) return false;
+        }
+        return frustum.Intersects(box);
+    }
+
+    // Expects to run inside BeginMode3D. DrawMode::Billboard takes the camera axes from the current
+    // modelview matrix, use Draw(camera) when other transforms are pushed on top of the camera.
+    void Draw() const {
+        Draw(rlGetMatrixModelview());
+    }
+
+    void Draw(const Camera& camera) const {
+        Draw(GetCameraMatrix(camera));
+    }
+
+    void Draw(const Matrix& view) const {
+        BeginBlendMode(config.blendMode);
+        DrawUnblended(view);
+        EndBlendMode();
+    }
+
+    // Draw(view) without touching the blend mode, for callers that set it once for several emitters
+    void DrawUnblended(const Matrix& view) const {
+        RP3D_ZONE("Emitter::Draw");
+        uint64_t start = statsEnabled ? StatsClock() : 0;
+        const uint32_t* order = nullptr;
+        size_t count = gpu ? 0 : DrawOrder(view, order);
+        DrawStats drawStats(*this, start, count);
+        if (gpu) {
+            gpu->Draw(config);
+        }
+        else if (config.drawMode == DrawMode::Instanced) {
+            instances.Clear();
+            AppendInstances(order, count, instances);
+            instances.Draw(config.model);
+        }
+        else if (config.drawMode == DrawMode::Billboard) {
+            billboards.Draw(Drawn(), colors, view, config.billboardSize, BillboardMaterial(), order, count);
+        }
+        else {
+            // DrawMesh with the particle transform, DrawModel would copy the model and rebuild the matrix
+            for (size_t k = 0; k < count; ++k) {
+                size_t i = order ? order[k] : k;
+                DrawTinted(ParticleTransform(i), ParticleColor(i));
+            }
+        }
+    }
+
+    const EmitterConfig& Config() const { return config; }
+    // Live particle arrays, empty on the GPU backend
+    const ParticleStore& Particles() const { return particles; }
+
+    // CPU emitters in DrawMode::Instanced can be merged with others sharing their model and blend mode
+    bool IsBatchable() const {
+        return !gpu && config.drawMode == DrawMode::Instanced;
+    }
+
+    // Appends the instances Draw(view) would submit, after culling and sorting, to a batch drawn by the caller
+    void AppendInstances(const Matrix& view, InstanceBatch& batch) const {
+        uint64_t start = statsEnabled ? StatsClock() : 0;
+        const uint32_t* order = nullptr;
+        size_t count = gpu ? 0 : DrawOrder(view, order);
+        DrawStats drawStats(*this, start, count);
+        AppendInstances(order, count, batch);
+    }
+
+private:
+    EmitterConfig config;
+    float mustEmit;
+    bool isEmitting;
+    float emissionTime = 0.0f;  // Seconds emitted since Start, for EmitterConfig::duration
+    ColorGradient colors;
+
+    // Fixed-size part of SaveState, followed by the particle arrays
+    struct SavedState {
+        uint64_t bytesPerParticle, count;  // Layout and size of the arrays
+        uint64_t capacity, peakLive;
+        uint64_t history;  // 1 when the previous positions follow the arrays
+        uint64_t gpuBurst, lastLive;
+        RandomGenerator rng;
+        BoundingBox bounds;
+        Vector3 origin, particleOrigin;  // The config's and the store's, which compact spawn origins are relative to
+        float mustEmit, emissionTime, pendingDt, idleTime;
+        unsigned ticks;
+        bool isEmitting;
+    };
+    std::unique_ptr<GpuParticleBackend> gpu;  // Set when the emitter runs on the GPU backend
+    size_t gpuBurst = 0;
+    ParticleStore particles;
+    std::pmr::vector<uint32_t> expired;  // Indices of particles that expired during the current update
+    std::pmr::memory_resource* memory;
+    std::unique_ptr<SnapshotBuffer> snapshots;  // Set by EnableSnapshots, what Draw reads in a pipelined system
+    RandomGenerator rng;
+    BoundingBox bounds;  // Particle positions, refreshed by Update and grown by Spawn
+    float particleRadius;  // Extent of one particle at scale 1
+    mutable std::pmr::vector<uint32_t> visible;  // EmitterConfig::cullParticles
+
+    // Level of detail state
+    static constexpr float maxStep = 1.0f / 30.0f;
+    static constexpr unsigned maxSubsteps = 8;
+    EmitterLod lod;
+    bool isOccluded = false;
+    bool statsEnabled = false;
+    mutable EmitterStats stats;  // Published by Update, the draw fields written by the draw calls
+    EmitterStats pending;  // Counted since the last published Update
+    const ColliderSet* colliders = nullptr;
+    AffectorList affectors;
+    const AffectorList* sharedAffectors = nullptr;
+    NeighborGrid neighbors;
+    float pendingDt = 0.0f;  // Time not simulated yet by a throttled emitter
+    unsigned ticks = 0;
+    unsigned long lastLive = 0;  // Live count after the last simulated step, stale by a frame on the GPU
+    float idleTime = 0.0f;  // OverflowPolicy::Grow: seconds the capacity has had a page or more to spare
+    size_t peakLive = 0;  // Most live particles over that time
+
+    // Parallel update state, one result per chunk on its own cache line
+    struct alignas(64) ChunkResult {
+        size_t expired;
+        BoundingBox bounds;
+    };
+    static constexpr size_t minChunkSize = 4096;
+    std::vector<ChunkResult> chunks;
+    ThreadPool* pool = nullptr;
+
+    // Per-frame instance data for DrawMode::Instanced, kept between frames to avoid reallocation
+    mutable InstanceBatch instances;
+    mutable BillboardRenderer billboards;  // DrawMode::Billboard
+    mutable DepthSorter sorter;  // EmitterConfig::depthSort
+
+    // Fills the draw fields of the stats once a draw call returns. `start` is taken before DrawOrder,
+    // which has run by the time this is built.
+    class DrawStats {
+    public:
+        DrawStats(const Emitter& e, uint64_t start, size_t count) : e(e) {
+            e.stats.drawn = count;
+            if (e.statsEnabled) {
+                culled = StatsClock();
+                e.stats.cullNs = culled - start;
+            }
+        }
+        ~DrawStats() {
+            if (e.statsEnabled) {
+                e.stats.drawNs = StatsClock() - culled;
+            }
+        }
+        DrawStats(const DrawStats&) = delete;
+        DrawStats& operator=(const DrawStats&) = delete;
+
+    private:
+        const Emitter& e;
+        uint64_t culled = 0;
+    };
+
+    // Particles to draw, after culling and sorting. Returns their count and sets `order` to their
+    // indices, or to null when they are the first `count` slots.
+    size_t DrawOrder(const Matrix& view, const uint32_t*& order) const {
+        const ParticleStore& drawn = Drawn();
+        size_t count = drawn.Size();
+        order = nullptr;
+        if (config.cullParticles) {
+            // Grown here rather than with the store, the draw may run on another thread
+            if (visible.size() < drawn.Capacity()) {
+                visible.resize(drawn.Capacity());
+            }
+            Frustum frustum = Frustum::FromMatrix(MatrixMultiply(view, rlGetMatrixProjection()));
+            count = CullKernel::Visible(drawn, frustum, particleRadius, visible.data());
+            order = visible.data();
+        }
+        if (config.depthSort) {
+            order = sorter.Sort(drawn, view, order, count);
+        }
+        return count;
+    }
+
+    void AppendInstances(const uint32_t* order, size_t count, InstanceBatch& batch) const {
+        for (size_t k = 0; k < count; ++k) {
+            size_t i = order ? order[k] : k;
+            batch.transforms.push_back(ParticleTransform(i));
+            batch.colors.push_back(ParticleColor(i));
+        }
+    }
+
+    // Billboards need no mesh, and an emitter without a model draws them with raylib's default
+    // shader and white texture, loaded once the first such emitter draws
+    const Material& BillboardMaterial() const {
+        if (config.model.materials != nullptr && config.model.materialCount > 0) return config.model.materials[0];
+        static const Material fallback = LoadMaterialDefault();
+        return fallback;
+    }
+
+    // Same tinting as DrawModel: the diffuse color is multiplied for the call and restored after
+    void DrawTinted(const Matrix& transform, Color tint) const {
+        const Model& model = config.model;
+        for (int m = 0; m < model.meshCount; ++m) {
+            Material& material = model.materials[model.meshMaterial[m]];
+            Color& diffuse = material.maps[MATERIAL_MAP_DIFFUSE].color;
+            Color base = diffuse;
+            diffuse = Color{
+                static_cast<unsigned char>(base.r * tint.r / 255),
+                static_cast<unsigned char>(base.g * tint.g / 255),
+                static_cast<unsigned char>(base.b * tint.b / 255),
+                static_cast<unsigned char>(base.a * tint.a / 255)
+            };
+            DrawMesh(model.meshes[m], material, transform);
+            diffuse = base;
+        }
+    }
+
+    // Draws every random number the batch needs up front, SpawnKernel turns them into particles
+    void Build(ParticleStore& s, size_t begin, size_t n, const SpawnParams& params) {
+        rng.FillFloat(s.vx + begin, n);
+        rng.FillFloat(s.vy + begin, n);
+        rng.FillFloat(s.vz + begin, n);
+        rng.FillFloat(s.px + begin, n);
+        rng.FillFloat(s.originAcceleration + begin, n);
+        rng.FillFloat(s.invTtl + begin, n);
+        SpawnKernel::Build(s, begin, begin + n, params);
+    }
+
+    // `stagger` spreads the birth of the particles spawned over the step, for Prewarm's coarse steps
+    unsigned long Step(float dt, bool stagger = false) {
+        RP3D_ZONE("Emitter::Step");
+        size_t emitNow = 0;
+
+        if (isEmitting) {
+            float emitDt = dt;
+            if (config.duration > 0.0f) {
+                emitDt = std::min(dt, config.duration - emissionTime);
+                emissionTime += dt;
+                isEmitting = emissionTime < config.duration;
+            }
+            mustEmit += emitDt * static_cast<float>(config.emissionRate) * lod.emissionScale;
+            emitNow = static_cast<size_t>(mustEmit);
+        }
+
+        if (gpu) {
+            // The GPU spawns into whatever slots are free and drops the rest
+            mustEmit -= static_cast<float>(emitNow);
+            unsigned long alive = gpu->Update(dt, emitNow + gpuBurst, config, rng);
+            gpuBurst = 0;
+            return alive;
+        }
+
+        // New particles are appended to the live range and integrated with the rest in the same pass.
+        // What does not fit stays in mustEmit until slots free up, unless the policy drops it.
+        uint64_t start = statsEnabled ? StatsClock() : 0;
+        size_t first = particles.Size();
+        size_t spawned = Place(emitNow);
+        if (config.overflow.policy == OverflowPolicy::Defer) {
+            mustEmit -= static_cast<float>(spawned);
+        }
+        else {
+            mustEmit -= static_cast<float>(emitNow);
+            pending.dropped += emitNow - spawned;
+        }
+        peakLive = std::max(peakLive, particles.Size());
+        if (statsEnabled) {
+            uint64_t now = StatsClock();
+            pending.spawnNs += now - start;
+            start = now;
+        }
+
+        particles.origin = config.origin;
+        if (config.interaction.model != InteractionModel::None) {
+            ThreadPool* threads = config.updateMode == UpdateMode::Parallel ? (pool ? pool : &ThreadPool::Default()) : nullptr;
+            neighbors.Apply(particles, config.interaction, dt, threads);
+        }
+        bool world = config.collision && colliders && !colliders->Empty();
+        KernelParams params{ dt, config.gravity, config.origin, config.externalAcceleration, config.collision && !world,
+                             world ? colliders : nullptr };
+        params.features = KernelParams::Features(config, params.collision);
+        params.affectors[0] = affectors.Empty() ? nullptr : &affectors;
+        params.affectors[1] = sharedAffectors && !sharedAffectors->Empty() ? sharedAffectors : nullptr;
+        bounds = ParticleKernel::EmptyBounds();
+        size_t removed = config.updateMode == UpdateMode::Parallel && particles.Size() > minChunkSize
+            ? UpdateParallel(params)
+            : ParticleKernel::Update(particles, 0, particles.Size(), params, expired.data(), bounds);
+        if (stagger) {
+            Stagger(first, spawned, dt);  // Before Remove, while the new particles still sit at the end
+        }
+        particles.Remove(expired.data(), removed);
+        particles.offsetOrigin = particles.origin;  // The update packed the compact spawn origins relative to it
+        pending.expired += removed;
+        if (config.overflow.policy == OverflowPolicy::Grow && config.overflow.shrinkDelay > 0.0f) {
+            ShrinkWhenIdle(dt);
+        }
+        if (statsEnabled) {
+            pending.updateNs += StatsClock() - start;
+        }
+        return static_cast<unsigned long>(particles.Size());
+    }
+
+    static size_t GrowthLimit(const EmitterConfig& cfg) {
+        return cfg.overflow.policy == OverflowPolicy::Grow ? std::max(cfg.capacity, cfg.overflow.maxCapacity) : cfg.capacity;
+    }
+
+    // `count` rounded up to whole pages of OverflowConfig::page, within the growth limit
+    size_t PageRound(size_t count) const {
+        size_t page = std::max<size_t>(config.overflow.page, 1);
+        return std::min((count + page - 1) / page * page, particles.MaxCapacity());
+    }
+
+    // Frees slots for `count` new particles as the overflow policy allows. The LOD limit still applies.
+    void MakeRoom(size_t count) {
+        size_t size = particles.Size();
+        if (config.overflow.policy == OverflowPolicy::Grow) {
+            Grow(PageRound(size + count));
+        }
+        else if (config.overflow.policy == OverflowPolicy::KillOldest) {
+            size_t limit = std::min(particles.Capacity(), lod.particleLimit);
+            size_t wanted = std::min(count, limit);
+            size_t free = limit > size ? limit - size : 0;
+            if (wanted > free) {
+                KillOldest(std::min(wanted - free, size));
+            }
+        }
+    }
+
+    // Raises the capacity, at most to the growth limit, with the expired list that follows it. The
+    // list keeps its size when the capacity shrinks again.
+    void Grow(size_t capacity) {
+        particles.Reserve(capacity);
+        if (expired.size() < particles.Capacity()) {
+            expired.resize(particles.Capacity());
+        }
+    }
+
+    // Removes the `count` particles with the largest life fraction. The index list borrows the
+    // expired buffer, which the update fills again afterwards.
+    void KillOldest(size_t count) {
+        uint32_t* order = expired.data();
+        size_t size = particles.Size();
+        for (size_t i = 0; i < size; ++i) {
+            order[i] = static_cast<uint32_t>(i);
+        }
+        std::nth_element(order, order + count - 1, order + size, [&](uint32_t a, uint32_t b) {
+            float la = particles.Life(a), lb = particles.Life(b);
+            return la != lb ? la > lb : a < b;
+        });
+        std::sort(order, order + count);
+        particles.Remove(order, count);
+        pending.killed += count;
+    }
+
+    // OverflowPolicy::Grow: once the last `shrinkDelay` seconds left a page or more unused, the
+    // capacity falls back to their peak, never below `capacity`
+    void ShrinkWhenIdle(float dt) {
+        size_t target = std::max(config.capacity, PageRound(peakLive));
+        if (target >= particles.Capacity()) {
+            idleTime = 0.0f;
+            peakLive = particles.Size();
+            return;
+        }
+        idleTime += dt;
+        if (idleTime < config.overflow.shrinkDelay) return;
+        particles.Shrink(target);
+        idleTime = 0.0f;
+        peakLive = particles.Size();
+    }
+
+    // Hands the counters of the finished Update to Stats, the draw fields are kept. Returns the live count.
+    unsigned long PublishStats() {
+        stats.live = LiveCount();
+        stats.spawned = pending.spawned;
+        stats.expired = pending.expired;
+        stats.dropped = pending.dropped;
+        stats.killed = pending.killed;
+        stats.spawnNs = pending.spawnNs;
+        stats.updateNs = pending.updateNs;
+        pending = EmitterStats{};
+        return stats.live;
+    }
+
+    // Spawn without the drop count, Step counts it as the overflow policy decides
+    size_t Place(size_t count) {
+        if (gpu) {
+            gpuBurst += count;
+            pending.spawned += count;
+            return count;
+        }
+        size_t room = lod.particleLimit > particles.Size() ? lod.particleLimit - particles.Size() : 0;
+        if (count > std::min(particles.Free(), room)) {
+            MakeRoom(count);
+            room = lod.particleLimit > particles.Size() ? lod.particleLimit - particles.Size() : 0;
+        }
+        size_t n = std::min({ count, particles.Free(), room });
+        pending.spawned += n;
+        if (n == 0) return 0;
+        RP3D_ZONE("Emitter::Spawn");
+        size_t begin = particles.Push(n);
+
+        SpawnParams params{
+            { config.directionAngle.min * DEG2RAD, config.directionAngle.max * DEG2RAD },
+            { config.velocityAngle.min * DEG2RAD, config.velocityAngle.max * DEG2RAD },
+            config.velocity, config.offset, config.originAcceleration, config.age, config.origin
+        };
+        if (particles.IsCompact()) {
+            // Built in the scratch store block by block, then packed into the new slots
+            ParticleStore& scratch = ParticleStore::Scratch();
+            for (size_t b = 0; b < n; b += ParticleStore::scratchSize) {
+                size_t m = std::min(ParticleStore::scratchSize, n - b);
+                Build(scratch, 0, m, params);
+                particles.Pack(scratch, begin + b, m, true);
+            }
+        }
+        else {
+            Build(particles, begin, n, params);
+        }
+        if (particles.prevX) {
+            // Drawn where they spawned until the next step
+            std::copy_n(particles.px + begin, n, particles.prevX + begin);
+            std::copy_n(particles.py + begin, n, particles.prevY + begin);
+            std::copy_n(particles.pz + begin, n, particles.prevZ + begin);
+        }
+
+        // Spawned particles sit within the offset range of the origin until the next update
+        float reach = std::max(std::abs(config.offset.min), std::abs(config.offset.max));
+        Vector3 extent = { reach, reach, reach };
+        bounds.min = Vector3Min(bounds.min, Vector3Subtract(config.origin, extent));
+        bounds.max = Vector3Max(bounds.max, Vector3Add(config.origin, extent));
+        return n;
+    }
+
+    // Moves the particles spawned this step back along their velocity and their age by a random part
+    // of the step, as if they had been emitted during it instead of all at its start. Runs after the
+    // update, when they are a whole step old, so no age goes below 0 and both layouts are treated alike.
+    void Stagger(size_t begin, size_t n, float dt) {
+        ParticleStore& s = particles;
+        for (size_t i = begin; i < begin + n; ++i) {
+            float t = rng.NextFloat() * dt;
+            if (s.IsCompact()) {
+                s.px[i] -= rp3d::simd::HalfToFloat(s.packed.vx[i]) * t;
+                s.py[i] -= rp3d::simd::HalfToFloat(s.packed.vy[i]) * t;
+                s.pz[i] -= rp3d::simd::HalfToFloat(s.packed.vz[i]) * t;
+                float back = t * rp3d::simd::HalfToFloat(s.packed.invTtl[i]) * 65535.0f;
+                s.packed.life[i] = static_cast<uint16_t>(std::max(s.packed.life[i] - back, 0.0f) + 0.5f);
+            }
+            else {
+                s.px[i] -= s.vx[i] * t;
+                s.py[i] -= s.vy[i] * t;
+                s.pz[i] -= s.vz[i] * t;
+                s.age[i] = std::max(s.age[i] - t, 0.0f);
+            }
+            Vector3 p = { s.px[i], s.py[i], s.pz[i] };
+            bounds.min = Vector3Min(bounds.min, p);
+            bounds.max = Vector3Max(bounds.max, p);
+        }
+    }
+
+    // Splits the live range into chunks that start on a cache line in every array. Each chunk writes the
+    // indices of its expired particles into its own slice of `expired`, and the slices are packed afterwards.
+    size_t UpdateParallel(const KernelParams& params) {
+        ThreadPool& threads = pool ? *pool : ThreadPool::Default();
+        constexpr size_t align = ParticleStore::laneBlock;
+        size_t size = particles.Size();
+        size_t chunk = std::max(minChunkSize, (size / (threads.Concurrency() * 4) + align - 1) / align * align);
+        size_t chunkCount = (size + chunk - 1) / chunk;
+        chunks.resize(chunkCount);
+
+        threads.ParallelFor(chunkCount, [&](size_t c) {
+            size_t begin = c * chunk;
+            size_t end = std::min(begin + chunk, size);
+            chunks[c].bounds = ParticleKernel::EmptyBounds();
+            chunks[c].expired = ParticleKernel::Update(particles, begin, end, params, expired.data() + begin, chunks[c].bounds);
+        });
+
+        size_t removed = 0;
+        for (size_t c = 0; c < chunkCount; ++c) {
+            std::copy_n(expired.data() + c * chunk, chunks[c].expired, expired.data() + removed);
+            removed += chunks[c].expired;
+            bounds.min = Vector3Min(bounds.min, chunks[c].bounds.min);
+            bounds.max = Vector3Max(bounds.max, chunks[c].bounds.max);
+        }
+        return removed;
+    }
+
+    // The particles Draw reads: the front snapshot when snapshots are enabled, the live store otherwise
+    const ParticleStore& Drawn() const {
+        return snapshots ? snapshots->Front().particles : particles;
+    }
+
+    BoundingBox Grow(const BoundingBox& box) const {
+        Vector3 radius = { particleRadius, particleRadius, particleRadius };
+        return { Vector3Subtract(box.min, radius), Vector3Add(box.max, radius) };
+    }
+
+    unsigned long LiveCount() const {
+        return gpu ? lastLive : static_cast<unsigned long>(particles.Size());
+    }
+
+    static float ParticleRadius(const EmitterConfig& cfg) {
+        if (cfg.drawMode == DrawMode::Billboard) {
+            return cfg.billboardSize * 0.70710678f;  // Half diagonal of the quad
+        }
+        if (cfg.model.meshCount == 0) return 0.0f;
+        // Farthest corner of the model box from its local origin, which ParticleTransform scales and moves
+        BoundingBox box = GetModelBoundingBox(cfg.model);
+        return Vector3Length(Vector3Max(Vector3Negate(box.min), box.max));
+    }
+
+    Matrix ParticleTransform(size_t i) const {
+        // Uniform scale followed by translation, written out instead of MatrixMultiply
+        const ParticleStore& drawn = Drawn();
+        float s = drawn.Scale(i);
+        Vector3 p = drawn.DrawPosition(i);
+        return Matrix{
+            s, 0.0f, 0.0f, p.x,
+            0.0f, s, 0.0f, p.y,
+            0.0f, 0.0f, s, p.z,
+            0.0f, 0.0f, 0.0f, 1.0f
+        };
+    }
+
+    Color ParticleColor(size_t i) const {
+        return colors.Sample(Drawn().Life(i));
     }
 };
 
-// Configuration structure for particle emitters
-struct EmitterConfig {
-    Vector3 direction;
-    FloatRange velocity, directionAngle, velocityAngle, offset, originAcceleration, age;
-    IntRange burst;
-    size_t capacity, emissionRate;
-    Vector3 origin, externalAcceleration;
-    Color startColor, endColor;
-    BlendMode blendMode;
-    Model model;  // 3D model to be used for particles
-    float gravity;  // Gravity affecting the particles
-    bool collision;  // Enable collision detection
-};
+// Binary effect file: the emitters of one ParticleSystem as fixed-layout records, mapped into memory
+// and read in place, without parsing. Models and textures are referenced by name and resolved when
+// the emitters are built. Files are written by EffectFile::Write or baked from text by EffectBake.cpp.
+// Layout, little-endian: Header, Record[emitterCount], ColorStop[stopCount], then the string table
+// of NUL-terminated names, which starts with the empty name.
+class EffectFile {
+public:
+    static constexpr uint32_t magic = 0x45335052;  // "RP3E"
+    static constexpr uint32_t version = 2;  // 2 added the overflow policy
+    static constexpr uint32_t maxParticles = 1u << 26;  // Largest capacity or maxCapacity a record may ask for
 
-// Particle structure, aligned for performance and SIMD optimization
-struct alignas(32) Particle {
-    Vector3 origin, position, velocity, externalAcceleration;
-    float originAcceleration, age, ttl, scale;
-    bool active;
+    struct Header {
+        uint32_t magic, version, fileSize;
+        uint32_t emitterCount, emitterOffset;
+        uint32_t stopCount, stopOffset;
+        uint32_t stringSize, stringOffset;
+    };
 
-    bool IsExpired() const {
-        return age > ttl;
+    // Record::flags bits
+    static constexpr uint32_t flagCollision = 1, flagScaleByDistance = 2, flagDepthSort = 4, flagCullParticles = 8;
+
+    // One EmitterConfig, every member 4 bytes wide so the records need no padding
+    struct Record {
+        Vector3 direction;
+        FloatRange velocity, directionAngle, velocityAngle, offset, originAcceleration, age;
+        IntRange burst;
+        uint32_t capacity, emissionRate;
+        float duration;
+        Vector3 origin, externalAcceleration;
+        Color startColor, endColor;
+        int32_t blendMode;
+        float gravity;
+        uint32_t flags;
+        uint32_t drawMode, layout, updateMode, backend;
+        float billboardSize, drawDistance;
+        uint32_t seedLow, seedHigh;
+        uint32_t firstStop, stopCount;  // Gradient, as a range of the stop table
+        uint32_t model, texture;  // Offsets in the string table, 0 for none
+        float modelSize;  // Edge of the plane built when only a texture is named
+        uint32_t interactionModel;
+        float radius, restDensity, stiffness, viscosity, separation, cohesion, alignment;
+        uint32_t overflowPolicy, maxCapacity, page;
+        float shrinkDelay;
+    };
+    static_assert(sizeof(Record) == 56 * 4 && sizeof(ColorStop) == 8, "effect records must not be padded");
+
+    // What Write stores for one emitter. The config's model and sharedModel are not written, the
+    // names are.
+    struct Source {
+        EmitterConfig config;
+        std::string model, texture;
+        float modelSize = 1.0f;
+    };
+
+    // Turns the names of a record into the emitter's model, may return null
+    using Resolver = std::function<ModelHandle(const std::string& model, const std::string& texture, float size)>;
+
+    // Default resolver on ModelCache::Default(): a model file, retextured when a texture is named as
+    // well, or a TexturedPlane of `size` when only a texture is named
+    static ModelHandle Resolve(const std::string& model, const std::string& texture, float size) {
+        if (!model.empty()) return ModelCache::Default().Load(model, texture);
+        if (!texture.empty()) return ModelCache::Default().TexturedPlane(texture, size);
+        return nullptr;
     }
 
-    void Init(const EmitterConfig& cfg) {
-        age = 0;
-        origin = cfg.origin;
+    EffectFile() = default;
+    ~EffectFile() { Close(); }
 
-        // Generate a random direction in 3D space
-        float theta = cfg.directionAngle.RandomValue() * DEG2RAD; // Azimuthal angle (around Y-axis)
-        float phi = cfg.velocityAngle.RandomValue() * DEG2RAD;    // Polar angle (from the Z-axis)
+    EffectFile(EffectFile&& o) noexcept { *this = std::move(o); }
+    EffectFile& operator=(EffectFile&& o) noexcept {
+        if (this != &o) {
+            Close();
+            std::swap(data, o.data);
+            std::swap(size, o.size);
+            std::swap(mapped, o.mapped);
+            buffer = std::move(o.buffer);
+            path = std::move(o.path);
+            stamp = o.stamp;
+        }
+        return *this;
+    }
 
-        float x = sinf(phi) * cosf(theta);
-        float y = cosf(phi);
-        float z = sinf(phi) * sinf(theta);
+    // Maps the file and checks that every offset stays inside it. Returns false, and logs why, when
+    // the file is missing, from another version or truncated.
+    bool Open(const std::string& file) {
+        Close();
+        path = file;
+        std::error_code ec;
+        stamp = std::filesystem::last_write_time(path, ec);
+        if (!Map()) {
+            TraceLog(LOG_WARNING, "RP3D: cannot read effect file %s", path.c_str());
+            return false;
+        }
+        if (!Validate()) {
+            TraceLog(LOG_WARNING, "RP3D: %s is not a version %u effect file", path.c_str(), version);
+            Close();
+            return false;
+        }
+        return true;
+    }
 
-        Vector3 randomDir = Vector3Normalize({ x, y, z });
+    bool IsOpen() const { return data != nullptr; }
+    const std::string& Path() const { return path; }
 
-        velocity = Vector3Scale(randomDir, cfg.velocity.RandomValue());
-        position = Vector3Add(cfg.origin, Vector3Scale(randomDir, cfg.offset.RandomValue()));
-        originAcceleration = cfg.originAcceleration.RandomValue();
-        externalAcceleration = cfg.externalAcceleration;
-        ttl = cfg.age.RandomValue();
-        scale = 1.0f;
-        active = true;
+    size_t Count() const { return data ? Head().emitterCount : 0; }
+    const Record& operator[](size_t i) const { return Records()[i]; }
+    const char* Name(uint32_t offset) const {
+        return reinterpret_cast<const char*>(data + Head().stringOffset + offset);
     }
 
+    // Config of emitter `i`, ready for ParticleSystem::Emplace
+    EmitterConfig Config(size_t i, const Resolver& resolve = Resolve) const {
+        const Record& r = Records()[i];
+        EmitterConfig cfg{};
+        cfg.direction = r.direction;
+        cfg.velocity = r.velocity;
+        cfg.directionAngle = r.directionAngle;
+        cfg.velocityAngle = r.velocityAngle;
+        cfg.offset = r.offset;
+        cfg.originAcceleration = r.originAcceleration;
+        cfg.age = r.age;
+        cfg.burst = r.burst;
+        cfg.capacity = r.capacity;
+        cfg.emissionRate = r.emissionRate;
+        cfg.duration = r.duration;
+        cfg.origin = r.origin;
+        cfg.externalAcceleration = r.externalAcceleration;
+        cfg.startColor = r.startColor;
+        cfg.endColor = r.endColor;
+        cfg.blendMode = static_cast<BlendMode>(r.blendMode);
+        cfg.gravity = r.gravity;
+        cfg.collision = (r.flags & flagCollision) != 0;
+        cfg.scaleByDistance = (r.flags & flagScaleByDistance) != 0;
+        cfg.seed = (static_cast<uint64_t>(r.seedHigh) << 32) | r.seedLow;
+        cfg.drawMode = static_cast<DrawMode>(r.drawMode);
+        cfg.layout = static_cast<ParticleLayout>(r.layout);
+        cfg.updateMode = static_cast<UpdateMode>(r.updateMode);
+        cfg.backend = static_cast<SimulationBackend>(r.backend);
+        cfg.billboardSize = r.billboardSize;
+        cfg.depthSort = (r.flags & flagDepthSort) != 0;
+        cfg.cullParticles = (r.flags & flagCullParticles) != 0;
+        cfg.drawDistance = r.drawDistance;
+        const ColorStop* stops = Stops() + r.firstStop;
+        cfg.gradient.assign(stops, stops + r.stopCount);
+        cfg.interaction = { static_cast<InteractionModel>(r.interactionModel), r.radius, r.restDensity,
+                            r.stiffness, r.viscosity, r.separation, r.cohesion, r.alignment };
+        cfg.overflow = { static_cast<OverflowPolicy>(r.overflowPolicy), r.maxCapacity, r.page, r.shrinkDelay };
+        cfg.sharedModel = resolve(Name(r.model), Name(r.texture), r.modelSize);
+        return cfg;
+    }
 
-    void Update(float dt, const EmitterConfig& cfg) {
-        if (!active) return;
+    // Hot reload: true when the file on disk is newer than the mapped one
+    bool Changed() const {
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(path, ec);
+        return !ec && time != stamp;
+    }
+    // Maps the current file. An invalid one is skipped until it changes again, the old mapping stays.
+    bool Reload() {
+        EffectFile next;
+        if (!next.Open(path)) {
+            std::error_code ec;
+            stamp = std::filesystem::last_write_time(path, ec);
+            return false;
+        }
+        *this = std::move(next);
+        return true;
+    }
 
-        age += dt;
-        if (IsExpired()) {
-            active = false;
-            return;
+    // Writes the file next to `file` and renames it over, so a process with the old file mapped
+    // keeps reading the old contents. Fails, writing nothing, when a config does not fit a record or
+    // would not pass Open.
+    static bool Write(const std::string& file, const std::vector<Source>& sources) {
+        std::vector<Record> records;
+        std::vector<ColorStop> stops;
+        std::string strings(1, '\0');
+        std::unordered_map<std::string, uint32_t> names;
+        auto name = [&](const std::string& s) -> uint32_t {
+            if (s.empty()) return 0;
+            auto [it, added] = names.try_emplace(s, static_cast<uint32_t>(strings.size()));
+            if (added) {
+                strings.append(s).push_back('\0');
+            }
+            return it->second;
+        };
+        for (const Source& source : sources) {
+            const EmitterConfig& c = source.config;
+            if (c.capacity > UINT32_MAX || c.emissionRate > UINT32_MAX || c.overflow.maxCapacity > UINT32_MAX
+                || c.overflow.page > UINT32_MAX) return false;
+            Record r{ c.direction, c.velocity, c.directionAngle, c.velocityAngle, c.offset, c.originAcceleration,
+                      c.age, c.burst, static_cast<uint32_t>(c.capacity), static_cast<uint32_t>(c.emissionRate),
+                      c.duration, c.origin, c.externalAcceleration, c.startColor, c.endColor, static_cast<int32_t>(c.blendMode),
+                      c.gravity, 0, static_cast<uint32_t>(c.drawMode), static_cast<uint32_t>(c.layout),
+                      static_cast<uint32_t>(c.updateMode), static_cast<uint32_t>(c.backend), c.billboardSize,
+                      c.drawDistance, static_cast<uint32_t>(c.seed), static_cast<uint32_t>(c.seed >> 32),
+                      static_cast<uint32_t>(stops.size()), static_cast<uint32_t>(c.gradient.size()),
+                      name(source.model), name(source.texture), source.modelSize,
+                      static_cast<uint32_t>(c.interaction.model), c.interaction.radius, c.interaction.restDensity,
+                      c.interaction.stiffness, c.interaction.viscosity, c.interaction.separation,
+                      c.interaction.cohesion, c.interaction.alignment, static_cast<uint32_t>(c.overflow.policy),
+                      static_cast<uint32_t>(c.overflow.maxCapacity), static_cast<uint32_t>(c.overflow.page),
+                      c.overflow.shrinkDelay };
+            r.flags = (c.collision ? flagCollision : 0u) | (c.scaleByDistance ? flagScaleByDistance : 0u)
+                    | (c.depthSort ? flagDepthSort : 0u) | (c.cullParticles ? flagCullParticles : 0u);
+            if (!InRange(r)) return false;
+            records.push_back(r);
+            stops.insert(stops.end(), c.gradient.begin(), c.gradient.end());
         }
 
-        velocity.y -= cfg.gravity * dt;
-        Vector3 toOrigin = Vector3Normalize(Vector3Subtract(origin, position));
-        velocity = Vector3Add(velocity, Vector3Scale(toOrigin, originAcceleration * dt));
-        velocity = Vector3Add(velocity, Vector3Scale(externalAcceleration, dt));
-        position = Vector3Add(position, Vector3Scale(velocity, dt));
+        Header h{};
+        h.magic = magic;
+        h.version = version;
+        h.emitterCount = static_cast<uint32_t>(records.size());
+        h.emitterOffset = sizeof(Header);
+        h.stopCount = static_cast<uint32_t>(stops.size());
+        h.stopOffset = h.emitterOffset + h.emitterCount * sizeof(Record);
+        h.stringSize = static_cast<uint32_t>(strings.size());
+        h.stringOffset = h.stopOffset + h.stopCount * sizeof(ColorStop);
+        h.fileSize = h.stringOffset + h.stringSize;
 
-        if (cfg.collision && position.y <= -1.0f) {
-            position.y = -1.0f;
-            velocity.y *= -0.5f; // Simple bounce with energy loss
+        std::string temp = file + ".tmp";
+        std::FILE* out = std::fopen(temp.c_str(), "wb");
+        if (!out) return false;
+        bool written = std::fwrite(&h, sizeof(h), 1, out) == 1
+            && std::fwrite(records.data(), sizeof(Record), records.size(), out) == records.size()
+            && std::fwrite(stops.data(), sizeof(ColorStop), stops.size(), out) == stops.size()
+            && std::fwrite(strings.data(), 1, strings.size(), out) == strings.size();
+        written = std::fclose(out) == 0 && written;
+        std::error_code ec;
+        if (written) {
+            std::filesystem::rename(temp, file, ec);
         }
-
-        scale = 1.0f / (Vector3Distance(position, cfg.origin) * 0.1f + 1.0f);
+        if (!written || ec) {
+            std::filesystem::remove(temp, ec);
+            return false;
+        }
+        return true;
     }
 
 private:
-    static Vector3 Rotate(const Vector3& v, float angleX, float angleY) {
-        static const float radConversion = DEG2RAD;
-        float radY = angleY * radConversion;
-        Vector3 rotatedY = {
-            cosf(radY) * v.x + sinf(radY) * v.z,
-            v.y,
-            -sinf(radY) * v.x + cosf(radY) * v.z
-        };
+    const std::byte* data = nullptr;
+    size_t size = 0;
+    void* mapped = nullptr;  // mmap'ed view, null when the file was read into `buffer`
+    std::unique_ptr<std::byte[]> buffer;
+    std::string path;
+    std::filesystem::file_time_type stamp{};
+
+    const Header& Head() const { return *reinterpret_cast<const Header*>(data); }
+    const Record* Records() const { return reinterpret_cast<const Record*>(data + Head().emitterOffset); }
+    const ColorStop* Stops() const { return reinterpret_cast<const ColorStop*>(data + Head().stopOffset); }
+
+    // Read-only private mapping on POSIX systems, a single read into memory elsewhere
+    bool Map() {
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        void* view = fstat(fd, &info) == 0 && info.st_size > 0
+            ? mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (view == MAP_FAILED) return false;
+        mapped = view;
+        data = static_cast<const std::byte*>(view);
+        size = static_cast<size_t>(info.st_size);
+#else
+        std::FILE* in = std::fopen(path.c_str(), "rb");
+        if (!in) return false;
+        std::error_code ec;
+        size_t bytes = static_cast<size_t>(std::filesystem::file_size(path, ec));
+        if (!ec && bytes > 0) {
+            buffer = std::make_unique<std::byte[]>(bytes);
+            if (std::fread(buffer.get(), 1, bytes, in) == bytes) {
+                data = buffer.get();
+                size = bytes;
+            }
+        }
+        std::fclose(in);
+        if (!data) return false;
+#endif
+        return true;
+    }
 
-        float radX = angleX * radConversion;
-        Vector3 rotatedX = {
-            rotatedY.x,
-            cosf(radX) * rotatedY.y - sinf(radX) * rotatedY.z,
-            sinf(radX) * rotatedY.y + cosf(radX) * rotatedY.z
+    void Close() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (mapped) {
+            munmap(mapped, size);
+        }
+#endif
+        mapped = nullptr;
+        buffer.reset();
+        data = nullptr;
+        size = 0;
+    }
+
+    // Bounds of every table and of every record's references, the only pass over the file
+    bool Validate() const {
+        if (size < sizeof(Header) || std::endian::native != std::endian::little) return false;
+        const Header& h = Head();
+        auto fits = [&](uint64_t offset, uint64_t count, uint64_t stride) {
+            return offset % 4 == 0 && offset + count * stride <= size;
         };
+        if (h.magic != magic || h.version != version || h.fileSize != size) return false;
+        if (!fits(h.emitterOffset, h.emitterCount, sizeof(Record)) || !fits(h.stopOffset, h.stopCount, sizeof(ColorStop))
+            || h.stringSize == 0 || uint64_t(h.stringOffset) + h.stringSize > size) return false;
+        const char* strings = reinterpret_cast<const char*>(data + h.stringOffset);
+        if (strings[0] != '\0' || strings[h.stringSize - 1] != '\0') return false;
+        for (uint32_t i = 0; i < h.emitterCount; ++i) {
+            const Record& r = Records()[i];
+            if (uint64_t(r.firstStop) + r.stopCount > h.stopCount || r.model >= h.stringSize || r.texture >= h.stringSize
+                || !InRange(r)) return false;
+        }
+        return true;
+    }
 
-        return rotatedX;
+    // Enums and sizes of one record, so a corrupt file fails Open instead of a later allocation
+    static bool InRange(const Record& r) {
+        return r.capacity != 0 && r.capacity <= maxParticles && r.maxCapacity <= maxParticles
+            && r.blendMode >= BLEND_ALPHA && r.blendMode <= BLEND_CUSTOM_SEPARATE
+            && r.drawMode <= uint32_t(DrawMode::Billboard) && r.layout <= uint32_t(ParticleLayout::Compact)
+            && r.updateMode <= uint32_t(UpdateMode::Parallel) && r.backend <= uint32_t(SimulationBackend::GPU)
+            && r.interactionModel <= uint32_t(InteractionModel::Flock)
+            && r.overflowPolicy <= uint32_t(OverflowPolicy::Defer);
     }
 };
 
-// Particle emitter class, managing the creation, updating, and drawing of particles
-class Emitter {
+// How ParticleSystem::Update schedules its emitters
+enum class ExecutionPolicy {
+    Sequential,  // One emitter after the other on the calling thread
+    Parallel     // Emitters run as tasks on the system's ThreadPool
+};
+
+// How ParticleSystem::Update lowers the detail of emitters far from the viewer. Between
+// fullDetailDistance and farDistance the emission and tick rate fall linearly to their minimum.
+struct LodPolicy {
+    float fullDetailDistance = 15.0f;  // Closer emitters run at full detail
+    float farDistance = 100.0f;  // Emitters beyond run at minimum detail
+    float minEmissionScale = 0.25f;  // Multiplies emissionRate at minimum detail
+    unsigned maxTickInterval = 4;  // Simulate every Nth frame at minimum detail
+    float minScreenHeight = 0.0f;  // Emitters projected smaller than this fraction of the screen height get minimum detail
+    bool pauseOccluded = true;  // Stop simulating emitters flagged with Emitter::SetOccluded
+    size_t particleBudget = 0;  // Live particles shared by all emitters, 0 for no limit
+};
+
+// Totals of a ParticleSystem over the active emitters. The update fields cover the last Update,
+// every fixed step of it, the draw fields the last Draw. The timings are wall time, once stats are
+// enabled; in pipelined mode the update fields are those of the last finished step.
+struct SystemStats {
+    unsigned long live = 0;
+    size_t spawned = 0;
+    size_t expired = 0;
+    size_t dropped = 0;  // Particles lost to full emitters or to the LOD budget
+    size_t killed = 0;  // Particles removed early by OverflowPolicy::KillOldest
+    size_t emitters = 0;  // Active emitters, one-shots in flight included
+    uint64_t updateNs = 0;
+    size_t drawn = 0;  // Particles submitted, after culling
+    size_t visible = 0;  // Emitters that passed the frustum and distance test
+    size_t batches = 0;  // Merged instanced draws
+    uint64_t drawNs = 0;
+};
+
+// Particle system class, managing multiple emitters
+class ParticleSystem {
 public:
-    Emitter(EmitterConfig cfg) 
-        : config(std::move(cfg)), mustEmit(0), isEmitting(false) {
-        config.direction = Vector3Normalize(config.direction);
-        particles.resize(config.capacity);
+    // Runs on the process-wide ThreadPool::Default()
+    ParticleSystem() : pool(&ThreadPool::Default()) {}
+
+    // Runs on a pool owned by this system, e.g. with fewer workers pinned to cores the game leaves free
+    explicit ParticleSystem(ThreadPoolOptions options)
+        : ownedPool(std::make_unique<ThreadPool>(std::move(options))), pool(ownedPool.get()) {}
+
+    // Runs on a pool shared with the caller, which must outlive the system
+    explicit ParticleSystem(ThreadPool& threads) : pool(&threads) {}
+
+    ~ParticleSystem() {
+        SetPipelined(false);
     }
-    void SetOrigin(const Vector3& newOrigin) {
-        config.origin = newOrigin;
+
+    // Sequential is the safe choice on older hardware or when the parallel backend is unavailable
+    void SetExecutionPolicy(ExecutionPolicy newPolicy) {
+        Wait();
+        policy = newPolicy;
+    }
+    // Enables level of detail, measured from the camera passed to SetViewer
+    void SetLodPolicy(const LodPolicy& newPolicy) {
+        lodPolicy = newPolicy;
+    }
+    void SetViewer(const Camera& camera) {
+        viewer = camera;
     }
-    void Start() { isEmitting = true; }
-    void Stop() { isEmitting = false; }
 
-    void Burst() {
-        size_t emitted = 0;
-        int amount = config.burst.RandomValue();
-        for (auto& p : particles) {
-            if (!p.active) {
-                p.Init(config);
-                if (++emitted >= amount) return;
-            }
+    // Simulates in steps of exactly `step` seconds, at most `maxSteps` per Update. Time beyond
+    // that is dropped, so a long hitch slows the effects down instead of stalling the next frames.
+    // Draw blends each particle between its last two steps. A step of 0 returns to variable steps.
+    void SetFixedTimestep(float step, unsigned maxSteps = 4) {
+        Wait();
+        fixedStep = std::max(step, 0.0f);
+        maxFixedSteps = std::max(maxSteps, 1u);
+        accumulator = 0.0f;
+        if (fixedStep > 0.0f) {
+            ForEachEmitter([](Emitter& e) { e.EnableInterpolation(); });
+        }
+        else {
+            SetInterpolation(1.0f);
         }
     }
 
-    unsigned long Update(float dt) {
-        size_t emitNow = 0;
-        unsigned long counter = 0;
+    // Carves the particle storage of every emitter built by Emplace and SpawnOneShot out of one
+    // block of `bytes`, so effects sit side by side in memory and adding them never goes to the
+    // global heap. Call once, before building any emitter.
+    void SetArena(size_t bytes) {
+        arena = std::make_unique<ParticleArena>(bytes);
+    }
+    const ParticleArena* Arena() const { return arena.get(); }
 
-        if (isEmitting) {
-            mustEmit += dt * static_cast<float>(config.emissionRate);
-            emitNow = static_cast<size_t>(mustEmit);
-        }
+    // Static geometry the emitters with `collision` set bounce off, in place of the y = -1 floor.
+    // Returns the collider's index. The spatial hash is rebuilt before the next update.
+    size_t AddCollider(Collider collider) {
+        Wait();
+        return colliders.Add(std::move(collider));
+    }
+    void ClearColliders() {
+        Wait();
+        colliders.Clear();
+    }
+    // Edge of the spatial hash cells, 0 by default to pick the median size of the colliders
+    void SetColliderCellSize(float size) {
+        Wait();
+        colliders.SetCellSize(size);
+    }
+    const ColliderSet& Colliders() const { return colliders; }
 
-        // Use a standard for_each without execution policy for compatibility
-        std::for_each(particles.begin(), particles.end(), [&](Particle& p) {
-            if (p.active) {
-                p.Update(dt, config);
-                ++counter;
-            }
-            else if (isEmitting && emitNow > 0) {
-                p.Init(config);
-                p.Update(dt, config);
-                --emitNow;
-                --mustEmit;
-                ++counter;
-            }
-            });
+    // Force fields applied to every CPU emitter of the system, after each emitter's own affectors.
+    // Returns the affector's index.
+    template <class A>
+    size_t AddAffector(A affector) {
+        Wait();
+        return affectors.Add(std::move(affector));
+    }
+    void ClearAffectors() {
+        Wait();
+        affectors.Clear();
+    }
+    const AffectorList& Affectors() const { return affectors; }
 
-        return counter;
+    // Pipelined mode: UpdateAsync hands the step to a simulation thread and returns at once, while
+    // Draw shows the snapshot each emitter published at the end of the previous step. Snapshots are
+    // swapped through three buffers, so neither thread waits for the other. LOD, one-shot recycling
+    // and the GPU emitters stay on the calling thread, which must own the GL context.
+    void SetPipelined(bool enabled) {
+        if (enabled == simulation.joinable()) return;
+        if (enabled) {
+            ForEachEmitter([](Emitter& e) { e.EnableSnapshots(); });
+            job.store(jobIdle);
+            simulation = std::thread([this] { Simulate(); });
+            return;
+        }
+        Wait();
+        job.store(jobStopping, std::memory_order_release);
+        job.notify_one();
+        simulation.join();
+        ForEachEmitter([](Emitter& e) { e.DisableSnapshots(); });
     }
+    bool IsPipelined() const { return simulation.joinable(); }
 
+    // Times each stage of every emitter and the system's own update and draw. The counters are
+    // kept either way.
+    void SetStatsEnabled(bool enabled) {
+        Wait();
+        statsEnabled = enabled;
+        ForEachEmitter([enabled](Emitter& e) { e.SetStatsEnabled(enabled); });
+    }
+    // Read it between steps in pipelined mode, e.g. right before UpdateAsync
+    const SystemStats& Stats() const { return stats; }
 
-    void Draw() const {
-        BeginBlendMode(config.blendMode);
-        for (const auto& p : particles) {
-            if (p.active) {
-                Matrix translation = MatrixTranslate(p.position.x, p.position.y, p.position.z);
-                Matrix scaling = MatrixScale(p.scale, p.scale, p.scale);
-                Model modelCopy = config.model; // Avoid modifying the original model's transform
-                modelCopy.transform = MatrixMultiply(scaling, translation);
-                DrawModel(modelCopy, p.position, 1.0f, LinearFade(config.startColor, config.endColor, p.age / p.ttl));
-            }
+    // Visits the emitters updated and drawn this frame, for their Emitter::Stats among others
+    template <class Fn>
+    void ForEachActiveEmitter(Fn&& fn) const {
+        for (const Active& a : active) {
+            fn(static_cast<const Emitter&>(*a.emitter));
         }
-        EndBlendMode();
     }
 
-private:
-    EmitterConfig config;
-    float mustEmit;
-    bool isEmitting;
-    std::vector<Particle> particles;
+    // True while the simulation thread runs a step. The emitters must not be changed until it is done,
+    // the system's own setters wait for it.
+    bool IsUpdating() const {
+        return job.load(std::memory_order_acquire) == jobRunning;
+    }
+    // Blocks until the running step, if any, is done
+    void Wait() const {
+        job.wait(jobRunning, std::memory_order_acquire);
+    }
 
-    static Color LinearFade(const Color& c1, const Color& c2, float fraction) {
-        return Color{
-            static_cast<unsigned char>((c2.r - c1.r) * fraction + c1.r),
-            static_cast<unsigned char>((c2.g - c1.g) * fraction + c1.g),
-            static_cast<unsigned char>((c2.b - c1.b) * fraction + c1.b),
-            static_cast<unsigned char>((c2.a - c1.a) * fraction + c1.a)
-        };
+    // Builds an emitter on the system's arena, when it has one, and registers it
+    Emitter& Emplace(EmitterConfig cfg) {
+        Register(std::make_unique<Emitter>(std::move(cfg), Memory()));
+        return *emitters.back();
     }
-};
 
-// Particle system class, managing multiple emitters
-class ParticleSystem {
-public:
     void Register(std::unique_ptr<Emitter> emitter) {
+        Wait();
+        Prepare(*emitter);
+        active.push_back({ emitter.get(), registered });
         emitters.push_back(std::move(emitter));
     }
 
+    // Registers one emitter per record of the effect file at `path`, in file order, with the models
+    // and textures named there resolved by `resolve`. Returns the effect id, or nothing when the
+    // file cannot be used.
+    std::optional<size_t> LoadEffect(const std::string& path, EffectFile::Resolver resolve = EffectFile::Resolve) {
+        auto effect = std::make_unique<Effect>();
+        if (!effect->file.Open(path)) return std::nullopt;
+        effect->resolve = std::move(resolve);
+        for (size_t i = 0; i < effect->file.Count(); ++i) {
+            effect->emitters.push_back(&Emplace(effect->file.Config(i, effect->resolve)));
+        }
+        effects.push_back(std::move(effect));
+        return effects.size() - 1;
+    }
+    // Emitters built from an effect, in file order. ReloadEffects replaces them.
+    const std::vector<Emitter*>& EffectEmitters(size_t effect) const {
+        return effects[effect]->emitters;
+    }
+
+    // Development hot reload: rebuilds the emitters of every effect whose file changed on disk since
+    // it was loaded. The new emitters keep the origin and the emission state of the ones they
+    // replace, their particles start over. Emitters the file no longer has are removed. Call it on
+    // the thread owning the GL context, e.g. once a second. Returns the number of effects reloaded.
+    size_t ReloadEffects() {
+        size_t reloaded = 0;
+        for (auto& effect : effects) {
+            if (!effect->file.Changed() || !effect->file.Reload()) continue;
+            Wait();
+            Rebuild(*effect);
+            ++reloaded;
+        }
+        return reloaded;
+    }
+
+    // Template for SpawnOneShot, with `poolSize` emitters built up front. Returns the prototype id.
+    size_t RegisterPrototype(EmitterConfig cfg, size_t poolSize) {
+        Wait();
+        prototypes.push_back({ std::move(cfg), {}, {} });
+        size_t id = prototypes.size() - 1;
+        for (size_t i = 0; i < poolSize; ++i) {
+            prototypes[id].idle.push_back(Grow(id));
+        }
+        return id;
+    }
+
+    // Starts a fire-and-forget effect at `origin`: one burst, then steady emission for the
+    // prototype's duration when it has one. The emitter comes from the prototype's pool and goes
+    // back to it once IsFinished, the pool only grows when every emitter is in use.
+    // While a pipelined step runs, the effect starts with the next UpdateAsync and null is returned.
+    Emitter* SpawnOneShot(size_t prototypeId, const Vector3& origin) {
+        if (IsUpdating()) {
+            deferred.push_back({ prototypeId, origin });
+            return nullptr;
+        }
+        Prototype& prototype = prototypes[prototypeId];
+        Emitter* emitter;
+        if (prototype.idle.empty()) {
+            emitter = Grow(prototypeId);
+        }
+        else {
+            emitter = prototype.idle.back();
+            prototype.idle.pop_back();
+        }
+        emitter->Restart(origin);
+        emitter->Burst();
+        if (prototype.config.emissionRate > 0 && prototype.config.duration > 0.0f) {
+            emitter->Start();
+        }
+        active.push_back({ emitter, prototypeId });
+        return emitter;
+    }
+
+    // One-shot emitters currently playing
+    size_t ActiveOneShots() const {
+        return active.size() - emitters.size();
+    }
+
     void SetOrigin(const Vector3& newOrigin) {
+        Wait();
         for (auto& e : emitters) {
             e->SetOrigin(newOrigin);
         }
     }
 
     void Start() {
+        Wait();
         for (auto& e : emitters) {
             e->Start();
         }
     }
 
     void Stop() {
+        Wait();
         for (auto& e : emitters) {
             e->Stop();
         }
     }
 
     void Burst() {
+        Wait();
         for (auto& e : emitters) {
             e->Burst();
         }
     }
 
-    unsigned long Update(float dt) {
-        unsigned long counter = 0;
+    // Fast-forwards every playing emitter by `seconds` in coarse steps, see Emitter::Prewarm
+    void Prewarm(float seconds, float step = 0.1f) {
+        Wait();
+        if (!colliders.IsBuilt()) {
+            colliders.Build();
+        }
+        for (const Active& a : active) {
+            a.emitter->Prewarm(seconds, step);
+            a.emitter->PublishSnapshot();
+        }
+    }
 
-        // Use sequential execution if parallel execution is causing issues
-        //std::for_each(emitters.begin(), emitters.end(), [&](std::unique_ptr<Emitter>& e) {
-        //    counter += e->Update(dt);
-        //    });
+    // Complete simulation state for replays and killcams: every emitter's particles, emission
+    // counters and random generator, the one-shots in flight and the fixed timestep. The particle
+    // arrays are copied as blocks. Plain bytes, restorable on the same platform and build.
+    std::vector<std::byte> SaveState() const {
+        Wait();
+        std::vector<std::byte> out;
+        SavedSystem header{ stateMagic, static_cast<uint32_t>(emitters.size()), static_cast<uint32_t>(prototypes.size()),
+                            static_cast<uint32_t>(active.size()), accumulator, live };
+        StateBlob::Put(out, header);
+        for (const auto& e : emitters) {
+            e->SaveState(out);
+        }
+        for (const Prototype& prototype : prototypes) {
+            StateBlob::Put(out, static_cast<uint32_t>(prototype.emitters.size()));
+            StateBlob::Put(out, static_cast<uint32_t>(prototype.idle.size()));
+            for (const Emitter* e : prototype.idle) {
+                StateBlob::Put(out, IndexIn(prototype.emitters, e));
+            }
+            for (const auto& e : prototype.emitters) {
+                e->SaveState(out);
+            }
+        }
+        for (const Active& a : active) {
+            const auto& owners = a.prototype == registered ? emitters : prototypes[a.prototype].emitters;
+            SavedActive entry{ a.prototype == registered ? noPrototype : static_cast<uint32_t>(a.prototype),
+                               IndexIn(owners, a.emitter) };
+            StateBlob::Put(out, entry);
+        }
+        return out;
+    }
 
-        // Alternatively, you can use parallel execution if your environment supports it
-        
-        std::for_each(std::execution::par, emitters.begin(), emitters.end(), [&](std::unique_ptr<Emitter>& e) {
-            counter += e->Update(dt);
-        });
-        
+    // Puts back a state from SaveState of this system, or of one built the same way: same registered
+    // emitters and prototypes. One-shot pools grow as needed. Returns false when the state does not
+    // fit, the emitters are then left as they were.
+    bool RestoreState(std::span<const std::byte> state) {
+        Wait();
+        SavedSystem header;
+        if (!StateBlob::Get(state, header) || header.magic != stateMagic || header.registered != emitters.size()
+            || header.prototypes != prototypes.size()) return false;
+        // Checked in full before anything changes
+        if (!ReadState(state, header, false)) return false;
+        ReadState(state, header, true);
+        accumulator = header.accumulator;
+        live = static_cast<unsigned long>(header.live);
+        pendingDt = 0.0f;
+        deferred.clear();
+        if (fixedStep > 0.0f) {
+            SetInterpolation(accumulator / fixedStep);
+        }
+        return true;
+    }
 
-        return counter;
+    // Returns the live particle count after the last simulated step
+    unsigned long Update(float dt) {
+        Wait();
+        Advance(dt, false);
+        Recycle();
+        return live;
     }
 
+    // Pipelined mode: starts simulating `dt` on the simulation thread and returns the live count of
+    // the last finished step. When the previous step is still running, `dt` is added to the next one.
+    unsigned long UpdateAsync(float dt) {
+        pendingDt += dt;
+        if (IsUpdating()) {
+            return asyncLive.load(std::memory_order_relaxed);
+        }
+        // The simulation thread is idle, the emitters belong to this thread until the job starts
+        Recycle();
+        for (const DeferredShot& shot : deferred) {
+            SpawnOneShot(shot.prototype, shot.origin);
+        }
+        deferred.clear();
+        if (lodPolicy) {
+            ApplyLod(*lodPolicy);
+        }
+        gpuLive = 0;
+        for (const Active& a : active) {
+            if (a.emitter->OnGpu()) {
+                gpuLive += a.emitter->Update(pendingDt);
+            }
+        }
+        jobDt = pendingDt;
+        pendingDt = 0.0f;
+        job.store(jobRunning, std::memory_order_release);
+        job.notify_one();
+        return asyncLive.load(std::memory_order_relaxed);
+    }
 
+    // Emitters are queued by blend mode, mesh and texture, so each blend mode is set once per frame.
+    // Instanced emitters that share a model and a blend mode are drawn together, in one
+    // DrawMeshInstanced call per mesh.
     void Draw() const {
-        for (const auto& e : emitters) {
-            e->Draw();
+        DrawEmitters(rlGetMatrixModelview(), nullptr, Vector3Zero());
+    }
+
+    // Skips the emitters outside the view frustum or beyond their drawDistance. Call it inside
+    // BeginMode3D(camera), the projection is taken from there.
+    void Draw(const Camera& camera) const {
+        Matrix view = GetCameraMatrix(camera);
+        Frustum frustum = Frustum::FromMatrix(MatrixMultiply(view, rlGetMatrixProjection()));
+        DrawEmitters(view, &frustum, camera.position);
+    }
+
+    void Unload() {
+        Wait();
+        ForEachEmitter([](Emitter& e) { e.Unload(); });
+        for (auto& batch : batches) {
+            batch->Unload();
         }
     }
 
 private:
+    struct alignas(64) EmitterCount {
+        unsigned long live;
+    };
+
+    std::unique_ptr<ThreadPool> ownedPool;
+    ThreadPool* pool;
+    std::unique_ptr<ParticleArena> arena;  // Declared before the emitters, which it outlives
     std::vector<std::unique_ptr<Emitter>> emitters;
+
+    // Emitters updated and drawn this frame: the registered ones, then the one-shots in flight
+    static constexpr size_t registered = std::numeric_limits<size_t>::max();
+    struct Active {
+        Emitter* emitter;
+        size_t prototype;  // `registered` for emitters added with Register
+    };
+    std::vector<Active> active;
+
+    struct Prototype {
+        EmitterConfig config;
+        std::vector<std::unique_ptr<Emitter>> emitters;  // Every emitter built for the prototype
+        std::vector<Emitter*> idle;
+    };
+    std::vector<Prototype> prototypes;
+
+    struct Effect {
+        EffectFile file;
+        EffectFile::Resolver resolve;
+        std::vector<Emitter*> emitters;  // Registered emitters built from the file
+    };
+    std::vector<std::unique_ptr<Effect>> effects;
+
+    // SaveState layout: SavedSystem, the registered emitters, per prototype its pool size, idle
+    // indices and emitters, then one SavedActive per entry of the active list
+    static constexpr uint32_t stateMagic = 0x53335052;  // "RP3S"
+    static constexpr uint32_t noPrototype = std::numeric_limits<uint32_t>::max();
+    struct SavedSystem {
+        uint32_t magic, registered, prototypes, active;
+        float accumulator;
+        uint64_t live;
+    };
+    struct SavedActive {
+        uint32_t prototype, index;
+    };
+    std::vector<EmitterCount> counts;
+    bool statsEnabled = false;
+    mutable SystemStats stats;  // The draw fields are written by Draw
+    ExecutionPolicy policy = ExecutionPolicy::Parallel;
+    std::optional<LodPolicy> lodPolicy;
+    std::optional<Camera> viewer;
+    std::vector<EmitterLod> levels;
+    std::vector<size_t> budgetOrder;
+    float fixedStep = 0.0f;  // SetFixedTimestep, 0 for variable steps
+    unsigned maxFixedSteps = 4;
+    float accumulator = 0.0f;  // Time not simulated yet, below one step
+    unsigned long live = 0;  // Live count after the last step
+    ColliderSet colliders;
+    AffectorList affectors;
+
+    // Pipelined mode. UpdateAsync sets `job` to running, the simulation thread back to idle; the
+    // emitters belong to whichever thread the state points at.
+    static constexpr unsigned jobIdle = 0, jobRunning = 1, jobStopping = 2;
+    std::thread simulation;
+    std::atomic<unsigned> job{ jobIdle };
+    float jobDt = 0.0f;  // Time simulated by the running job
+    float pendingDt = 0.0f;  // Time passed to UpdateAsync since the last job started
+    unsigned long gpuLive = 0;  // Live count of the GPU emitters, updated by UpdateAsync
+    std::atomic<unsigned long> asyncLive{ 0 };
+    struct DeferredShot {
+        size_t prototype;
+        Vector3 origin;
+    };
+    std::vector<DeferredShot> deferred;  // SpawnOneShot calls made while a job ran
+
+    // Render queue, one entry per visible emitter. Sorting by the key puts emitters sharing a blend
+    // mode, then a mesh, then a texture next to each other. Instanced emitters with the same model
+    // end up adjacent and are merged into one batch.
+    struct QueueEntry {
+        int blendMode;
+        const Mesh* meshes;  // Null for billboards, which bring their own quads
+        unsigned int texture;
+        const Material* materials;
+        bool batchable;
+        size_t index;  // Position in the active list, keeps equal keys in registration order
+        const Emitter* emitter;
+
+        bool operator<(const QueueEntry& o) const {
+            if (blendMode != o.blendMode) return blendMode < o.blendMode;
+            if (meshes != o.meshes) return std::less<const Mesh*>()(meshes, o.meshes);
+            if (texture != o.texture) return texture < o.texture;
+            if (materials != o.materials) return std::less<const Material*>()(materials, o.materials);
+            if (batchable != o.batchable) return batchable < o.batchable;
+            return index < o.index;
+        }
+
+        bool SameBatch(const QueueEntry& o) const {
+            return batchable && o.batchable && blendMode == o.blendMode && meshes == o.meshes
+                && materials == o.materials;
+        }
+    };
+    mutable std::vector<QueueEntry> queue;
+    mutable std::vector<std::unique_ptr<InstanceBatch>> batches;
+
+    static QueueEntry MakeEntry(const Emitter& e, size_t index) {
+        const EmitterConfig& cfg = e.Config();
+        const Material* materials = cfg.model.materials;
+        unsigned int texture = materials ? materials[0].maps[MATERIAL_MAP_DIFFUSE].texture.id : 0;
+        const Mesh* meshes = cfg.drawMode == DrawMode::Billboard ? nullptr : cfg.model.meshes;
+        return { cfg.blendMode, meshes, texture, materials, e.IsBatchable(), index, &e };
+    }
+
+    // BLEND_ALPHA sorts first, it is rlgl's default and needs no state change after 2D drawing.
+    // Within a blend mode the draw order follows the key, and the registration order among equal keys.
+    void DrawEmitters(const Matrix& view, const Frustum* frustum, const Vector3& viewer) const {
+        RP3D_ZONE("ParticleSystem::Draw");
+        uint64_t start = statsEnabled ? StatsClock() : 0;
+        queue.clear();
+        for (size_t i = 0; i < active.size(); ++i) {
+            active[i].emitter->AcquireSnapshot();
+            const Emitter& e = *active[i].emitter;
+            if (frustum && !e.IsVisible(*frustum, viewer)) continue;
+            queue.push_back(MakeEntry(e, i));
+        }
+        // std::sort with the index as the last key, stable_sort would allocate a buffer every frame
+        std::sort(queue.begin(), queue.end());
+
+        size_t batchCount = 0;
+        for (size_t i = 0; i < queue.size();) {
+            int blendMode = queue[i].blendMode;
+            BeginBlendMode(blendMode);
+            for (; i < queue.size() && queue[i].blendMode == blendMode;) {
+                const QueueEntry& entry = queue[i];
+                if (!entry.batchable) {
+                    entry.emitter->DrawUnblended(view);
+                    ++i;
+                    continue;
+                }
+                if (batchCount == batches.size()) {
+                    batches.push_back(std::make_unique<InstanceBatch>());
+                }
+                InstanceBatch& batch = *batches[batchCount++];
+                batch.Clear();
+                for (; i < queue.size() && queue[i].SameBatch(entry); ++i) {
+                    queue[i].emitter->AppendInstances(view, batch);
+                }
+                batch.Draw(entry.emitter->Config().model);
+            }
+        }
+        if (!queue.empty()) {
+            EndBlendMode();
+        }
+
+        stats.drawn = 0;
+        for (const QueueEntry& entry : queue) {
+            stats.drawn += entry.emitter->Stats().drawn;
+        }
+        stats.visible = queue.size();
+        stats.batches = batchCount;
+        stats.drawNs = statsEnabled ? StatsClock() - start : 0;
+    }
+
+    // Runs `dt` in one variable step or in fixed steps. The pipelined job leaves LOD and the GPU
+    // emitters to UpdateAsync.
+    void Advance(float dt, bool pipelined) {
+        RP3D_ZONE("ParticleSystem::Update");
+        uint64_t start = statsEnabled ? StatsClock() : 0;
+        stats.spawned = stats.expired = stats.dropped = stats.killed = 0;
+        if (!colliders.IsBuilt()) {
+            colliders.Build();
+        }
+        if (fixedStep <= 0.0f) {
+            live = Step(dt, pipelined);
+        }
+        else {
+            accumulator += dt;
+            unsigned steps = 0;
+            while (accumulator >= fixedStep && steps < maxFixedSteps) {
+                live = Step(fixedStep, pipelined);
+                accumulator -= fixedStep;
+                ++steps;
+            }
+            accumulator = std::min(accumulator, fixedStep);
+            SetInterpolation(accumulator / fixedStep);
+        }
+        stats.live = live;
+        stats.emitters = active.size();
+        stats.updateNs = statsEnabled ? StatsClock() - start : 0;
+    }
+
+    // One simulation step of every active emitter, with LOD applied first
+    unsigned long Step(float dt, bool pipelined) {
+        if (lodPolicy && !pipelined) {
+            ApplyLod(*lodPolicy);
+        }
+        auto update = [&](Emitter& e) -> unsigned long {
+            return pipelined && e.OnGpu() ? 0 : e.Update(dt);
+        };
+        unsigned long counter = 0;
+        if (policy == ExecutionPolicy::Parallel) {
+            // Every task writes its own padded slot, the slots are summed once all tasks are done.
+            // Emitters in UpdateMode::Parallel schedule their chunks on the same pool from inside these tasks.
+            counts.resize(active.size());
+            pool->ParallelFor(active.size(), [&](size_t i) {
+                counts[i].live = update(*active[i].emitter);
+            });
+            for (const auto& c : counts) {
+                counter += c.live;
+            }
+        }
+        else {
+            for (const Active& a : active) {
+                counter += update(*a.emitter);
+            }
+        }
+        // The pipelined job leaves the GPU emitters to UpdateAsync, they are not counted
+        for (const Active& a : active) {
+            if (pipelined && a.emitter->OnGpu()) continue;
+            const EmitterStats& s = a.emitter->Stats();
+            stats.spawned += s.spawned;
+            stats.expired += s.expired;
+            stats.dropped += s.dropped;
+            stats.killed += s.killed;
+        }
+        return counter;
+    }
+
+    // Simulation thread: sleeps until UpdateAsync starts a job, runs it and publishes the snapshots
+    void Simulate() {
+        for (;;) {
+            job.wait(jobIdle, std::memory_order_acquire);
+            if (job.load(std::memory_order_acquire) == jobStopping) return;
+            Advance(jobDt, true);
+            for (const Active& a : active) {
+                a.emitter->PublishSnapshot();
+            }
+            asyncLive.store(live + gpuLive, std::memory_order_relaxed);
+            job.store(jobIdle, std::memory_order_release);
+            job.notify_all();
+        }
+    }
+
+    void SetInterpolation(float alpha) {
+        for (const Active& a : active) {
+            a.emitter->SetInterpolation(alpha);
+        }
+    }
+
+    void ApplyLod(const LodPolicy& p) {
+        levels.assign(active.size(), EmitterLod{});
+        for (size_t i = 0; i < active.size(); ++i) {
+            const Emitter& e = *active[i].emitter;
+            EmitterLod& level = levels[i];
+            level.tickPhase = static_cast<unsigned>(i);
+            level.paused = p.pauseOccluded && e.IsOccluded();
+            if (viewer) {
+                float distance, radius;
+                e.Extent(viewer->position, distance, radius);
+                float span = std::max(p.farDistance - p.fullDetailDistance, 1e-3f);
+                float t = std::clamp((distance - p.fullDetailDistance) / span, 0.0f, 1.0f);
+                if (ScreenHeight(*viewer, distance, radius) < p.minScreenHeight) {
+                    t = 1.0f;
+                }
+                level.emissionScale = Lerp(1.0f, p.minEmissionScale, t);
+                level.tickInterval = 1 + static_cast<unsigned>(t * (std::max(p.maxTickInterval, 1u) - 1) + 0.5f);
+            }
+        }
+        if (p.particleBudget > 0) {
+            SplitBudget(p.particleBudget);
+        }
+        for (size_t i = 0; i < active.size(); ++i) {
+            active[i].emitter->SetLod(levels[i]);
+        }
+    }
+
+    // Registered emitters and every pooled one, idle or playing
+    template <class Fn>
+    void ForEachEmitter(Fn&& fn) {
+        for (auto& e : emitters) {
+            fn(*e);
+        }
+        for (auto& prototype : prototypes) {
+            for (auto& e : prototype.emitters) {
+                fn(*e);
+            }
+        }
+    }
+
+    std::pmr::memory_resource* Memory() const {
+        return arena ? arena.get() : std::pmr::get_default_resource();
+    }
+
+    // Builds one more emitter for a prototype. Seeded prototypes give each emitter its own sequence.
+    Emitter* Grow(size_t prototypeId) {
+        Prototype& prototype = prototypes[prototypeId];
+        EmitterConfig cfg = prototype.config;
+        if (cfg.seed != 0) {
+            cfg.seed += prototype.emitters.size();
+        }
+        prototype.emitters.push_back(std::make_unique<Emitter>(std::move(cfg), Memory()));
+        prototype.idle.reserve(prototype.emitters.size());
+        Emitter* emitter = prototype.emitters.back().get();
+        Prepare(*emitter);
+        return emitter;
+    }
+
+    // Brings a new emitter in line with the system's modes
+    void Prepare(Emitter& emitter) {
+        emitter.SetThreadPool(pool);
+        emitter.SetColliders(&colliders);
+        emitter.SetSharedAffectors(&affectors);
+        if (fixedStep > 0.0f) {
+            emitter.EnableInterpolation();
+        }
+        if (IsPipelined()) {
+            emitter.EnableSnapshots();
+        }
+        emitter.SetStatsEnabled(statsEnabled);
+    }
+
+    template <class List>
+    static uint32_t IndexIn(const List& list, const Emitter* emitter) {
+        auto it = std::find_if(list.begin(), list.end(), [&](const auto& e) { return e.get() == emitter; });
+        return static_cast<uint32_t>(it - list.begin());
+    }
+
+    // Walks a state after its header. With `apply` false only checks it, growing the one-shot pools
+    // the state needs, with `apply` set restores it.
+    bool ReadState(std::span<const std::byte> in, const SavedSystem& header, bool apply) {
+        for (auto& e : emitters) {
+            if (!e->RestoreState(in, apply)) return false;
+        }
+        std::vector<std::vector<Emitter*>> idle(prototypes.size());
+        std::vector<uint32_t> sizes(prototypes.size());
+        for (size_t p = 0; p < prototypes.size(); ++p) {
+            uint32_t& count = sizes[p];
+            uint32_t idleCount;
+            if (!StateBlob::Get(in, count) || !StateBlob::Get(in, idleCount) || idleCount > count) return false;
+            while (prototypes[p].emitters.size() < count) {
+                Grow(p);
+            }
+            for (uint32_t k = 0; k < idleCount; ++k) {
+                uint32_t index;
+                if (!StateBlob::Get(in, index) || index >= count) return false;
+                idle[p].push_back(prototypes[p].emitters[index].get());
+            }
+            for (uint32_t k = 0; k < count; ++k) {
+                if (!prototypes[p].emitters[k]->RestoreState(in, apply)) return false;
+            }
+        }
+        std::vector<Active> entries;
+        for (uint32_t k = 0; k < header.active; ++k) {
+            SavedActive entry;
+            if (!StateBlob::Get(in, entry)) return false;
+            bool own = entry.prototype == noPrototype;
+            if (!own && entry.prototype >= prototypes.size()) return false;
+            const auto& owners = own ? emitters : prototypes[entry.prototype].emitters;
+            if (entry.index >= (own ? owners.size() : sizes[entry.prototype])) return false;
+            entries.push_back({ owners[entry.index].get(), own ? registered : entry.prototype });
+        }
+        if (apply) {
+            active = std::move(entries);
+            for (size_t p = 0; p < prototypes.size(); ++p) {
+                prototypes[p].idle = std::move(idle[p]);
+                // Emitters built after the state was saved go, so the pool grows with the same seeds again
+                auto& pool = prototypes[p].emitters;
+                for (size_t k = sizes[p]; k < pool.size(); ++k) {
+                    pool[k]->Unload();
+                }
+                pool.resize(sizes[p]);
+            }
+        }
+        return true;
+    }
+
+    // Swaps the emitters of an effect for ones built from its reloaded file
+    void Rebuild(Effect& effect) {
+        std::vector<Emitter*> old = std::move(effect.emitters);
+        bool emitting = std::any_of(old.begin(), old.end(), [](const Emitter* e) { return e->IsEmitting(); });
+        effect.emitters.clear();
+        for (size_t i = 0; i < effect.file.Count(); ++i) {
+            EmitterConfig cfg = effect.file.Config(i, effect.resolve);
+            if (i >= old.size()) {
+                Emitter& added = Emplace(std::move(cfg));
+                if (emitting) {
+                    added.Start();
+                }
+                effect.emitters.push_back(&added);
+                continue;
+            }
+            cfg.origin = old[i]->Config().origin;
+            auto next = std::make_unique<Emitter>(std::move(cfg), Memory());
+            Prepare(*next);
+            if (old[i]->IsEmitting()) {
+                next->Start();
+            }
+            effect.emitters.push_back(next.get());
+            Replace(old[i], std::move(next));
+        }
+        for (size_t i = effect.file.Count(); i < old.size(); ++i) {
+            Replace(old[i], nullptr);
+        }
+    }
+
+    // Puts `next` in the place of a registered emitter, or removes it when `next` is null
+    void Replace(Emitter* emitter, std::unique_ptr<Emitter> next) {
+        auto slot = std::find_if(emitters.begin(), emitters.end(), [&](const auto& e) { return e.get() == emitter; });
+        auto entry = std::find_if(active.begin(), active.end(), [&](const Active& a) { return a.emitter == emitter; });
+        emitter->Unload();
+        if (next) {
+            entry->emitter = next.get();
+            *slot = std::move(next);
+        }
+        else {
+            active.erase(entry);
+            emitters.erase(slot);
+        }
+    }
+
+    // Hands finished one-shots back to their pools, keeping the order of the others
+    void Recycle() {
+        auto end = std::remove_if(active.begin(), active.end(), [&](const Active& a) {
+            if (a.prototype == registered || !a.emitter->IsFinished()) return false;
+            a.emitter->TrimCapacity();
+            prototypes[a.prototype].idle.push_back(a.emitter);
+            return true;
+        });
+        active.erase(end, active.end());
+    }
+
+    // Water-filling: emitters asking for less than an even share keep what they ask for, and what
+    // they leave is shared among the others. The demand is the largest capacity scaled by the LOD emission.
+    void SplitBudget(size_t budget) {
+        auto demand = [&](size_t i) {
+            if (levels[i].paused) return size_t(0);
+            return static_cast<size_t>(std::ceil(active[i].emitter->MaxCapacity() * levels[i].emissionScale));
+        };
+        budgetOrder.resize(active.size());
+        for (size_t i = 0; i < budgetOrder.size(); ++i) {
+            budgetOrder[i] = i;
+        }
+        std::sort(budgetOrder.begin(), budgetOrder.end(), [&](size_t a, size_t b) { return demand(a) < demand(b); });
+
+        size_t remaining = budget;
+        for (size_t k = 0; k < budgetOrder.size(); ++k) {
+            size_t i = budgetOrder[k];
+            size_t share = remaining / (budgetOrder.size() - k);
+            levels[i].particleLimit = std::min(demand(i), share);
+            remaining -= levels[i].particleLimit;
+        }
+    }
+
+    // Projected height of a sphere as a fraction of the screen height
+    static float ScreenHeight(const Camera& camera, float distance, float radius) {
+        if (camera.projection == CAMERA_ORTHOGRAPHIC) {
+            return 2.0f * radius / camera.fovy;
+        }
+        float halfHeight = std::max(distance, 1e-3f) * std::tan(camera.fovy * DEG2RAD * 0.5f);
+        return radius / halfHeight;
+    }
 };
 
@@ -0,0 +1,509 @@
+// Headless tests: no window is opened, only the CPU paths are checked. Every failed check prints
+// its name, and the exit status is the number of failures.
+//
+//   Tests          run every check
+//
+// Determinism: an emitter updated with UpdateMode::Parallel, and a system updated with
+// ExecutionPolicy::Parallel, save the same bytes as their serial runs, on pools of any size.
+// Kernel: ParticleKernel::Update matches a scalar reference for every feature combination, in both
+// layouts, and lists the expired particles in ascending order. ParticleStore::Remove keeps exactly
+// the particles not listed, for lists in any order and with repeats.
+// Overflow: the counters of every OverflowPolicy add up, KillOldest removes the oldest particles,
+// and Grow adds and gives back whole pages of a store that stays in place.
+
+#include "RayParticle3D.h"
+#include <iostream>
+#include <numeric>
+
+namespace {
+
+constexpr float frameTime = 1.0f / 60.0f;
+
+int failures = 0;
+
+void Check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cout << "FAILED: " << what << "\n";
+        ++failures;
+    }
+}
+
+const char* LayoutName(ParticleLayout layout) {
+    return layout == ParticleLayout::Compact ? "compact" : "full";
+}
+
+// A fountain with every kernel stage on, that keeps about `capacity` particles alive once warmed up
+EmitterConfig BaseConfig(size_t capacity) {
+    EmitterConfig c{};
+    c.direction = { 0.0f, 1.0f, 0.0f };
+    c.velocity = { 1.0f, 3.0f };
+    c.directionAngle = { -30.0f, 30.0f };
+    c.velocityAngle = { -180.0f, 180.0f };
+    c.offset = { 0.0f, 0.5f };
+    c.originAcceleration = { 0.2f, 0.5f };
+    c.age = { 1.0f, 2.0f };
+    c.burst = { 10, 20 };
+    c.capacity = capacity;
+    c.emissionRate = static_cast<size_t>(capacity / 1.5);
+    c.gravity = 0.5f;
+    c.collision = true;
+    c.seed = 1;
+    return c;
+}
+
+std::vector<std::byte> Save(const Emitter& emitter) {
+    std::vector<std::byte> state;
+    emitter.SaveState(state);
+    return state;
+}
+
+// Runs `frames` updates and returns the saved state
+std::vector<std::byte> Run(const EmitterConfig& cfg, ThreadPool* pool, int frames) {
+    Emitter emitter(cfg);
+    emitter.SetThreadPool(pool);
+    ColliderSet colliders;
+    colliders.Add(Collider::Plane({ 0.0f, 1.0f, 0.0f }, -1.0f));
+    colliders.Add(Collider::Sphere({ 1.0f, 0.5f, 0.0f }, 0.5f));
+    colliders.Build();
+    if (cfg.collision) {
+        emitter.SetColliders(&colliders);
+    }
+    emitter.AddAffector(Drag{ 0.3f });
+    emitter.AddAffector(Turbulence{ 0.5f, 0.8f });
+    emitter.Start();
+    for (int f = 0; f < frames; ++f) {
+        emitter.Update(frameTime);
+    }
+    return Save(emitter);
+}
+
+void TestParallelEmitter() {
+    struct Variant {
+        const char* name;
+        void (*configure)(EmitterConfig& cfg);
+    };
+    const Variant variants[] = {
+        { "full", [](EmitterConfig&) {} },
+        { "compact", [](EmitterConfig& c) { c.layout = ParticleLayout::Compact; } },
+        { "fluid", [](EmitterConfig& c) {
+            c.interaction.model = InteractionModel::Fluid;
+            c.interaction.radius = 0.1f;
+        } },
+    };
+    for (const Variant& v : variants) {
+        EmitterConfig serial = BaseConfig(20000);
+        v.configure(serial);
+        std::vector<std::byte> expected = Run(serial, nullptr, 120);
+        EmitterConfig parallel = serial;
+        parallel.updateMode = UpdateMode::Parallel;
+        for (size_t workers : { 1, 3, 7 }) {
+            ThreadPool pool(workers);
+            Check(Run(parallel, &pool, 120) == expected,
+                  std::string("parallel emitter, ") + v.name + ", " + std::to_string(workers) + " workers");
+        }
+    }
+}
+
+std::vector<std::byte> RunSystem(ExecutionPolicy policy, ThreadPool& pool) {
+    ParticleSystem system(pool);
+    system.SetExecutionPolicy(policy);
+    for (int i = 0; i < 6; ++i) {
+        EmitterConfig cfg = BaseConfig(3000 + 3000 * i);
+        cfg.seed = 10 + i;
+        cfg.origin = { static_cast<float>(i), 0.0f, 0.0f };
+        cfg.updateMode = i % 2 ? UpdateMode::Parallel : UpdateMode::Serial;
+        system.Emplace(cfg);
+    }
+    system.Start();
+    for (int f = 0; f < 120; ++f) {
+        system.Update(frameTime);
+    }
+    return system.SaveState();
+}
+
+void TestParallelSystem() {
+    ThreadPool single(0);
+    std::vector<std::byte> expected = RunSystem(ExecutionPolicy::Sequential, single);
+    for (size_t workers : { 1, 3, 7 }) {
+        ThreadPool pool(workers);
+        Check(RunSystem(ExecutionPolicy::Parallel, pool) == expected,
+              "parallel system, " + std::to_string(workers) + " workers");
+        Check(RunSystem(ExecutionPolicy::Sequential, pool) == expected,
+              "sequential system, " + std::to_string(workers) + " workers");
+    }
+}
+
+// One particle as the original per-particle update saw it
+struct Reference {
+    Vector3 position, velocity, origin;
+    float originAcceleration, age, invTtl, scale;
+};
+
+Reference Load(const ParticleStore& s, size_t i) {
+    return { { s.px[i], s.py[i], s.pz[i] }, { s.vx[i], s.vy[i], s.vz[i] }, { s.ox[i], s.oy[i], s.oz[i] },
+             s.originAcceleration[i], s.age[i], s.invTtl[i], 1.0f };
+}
+
+// Scalar reference of ParticleKernel::Update, one particle at a time with raymath. Returns false
+// when the particle expired, which leaves the rest unchanged.
+bool Advance(Reference& p, const KernelParams& k) {
+    p.age += k.dt;
+    if (p.age * p.invTtl > 1.0f) return false;
+    if (k.features & KernelAcceleration) {
+        p.velocity.y -= k.gravity * k.dt;
+    }
+    if (k.features & KernelAttraction) {
+        Vector3 toOrigin = Vector3Normalize(Vector3Subtract(p.origin, p.position));
+        p.velocity = Vector3Add(p.velocity, Vector3Scale(toOrigin, p.originAcceleration * k.dt));
+    }
+    if (k.features & KernelAcceleration) {
+        p.velocity = Vector3Add(p.velocity, Vector3Scale(k.externalAcceleration, k.dt));
+    }
+    p.position = Vector3Add(p.position, Vector3Scale(p.velocity, k.dt));
+    if ((k.features & KernelFloor) && p.position.y <= -1.0f) {
+        p.position.y = -1.0f;
+        p.velocity.y *= -0.5f;
+    }
+    if (k.features & KernelScale) {
+        p.scale = 1.0f / (Vector3Distance(p.position, k.origin) * 0.1f + 1.0f);
+    }
+    return true;
+}
+
+bool Near(float a, float b, float tolerance) {
+    return std::abs(a - b) <= tolerance * std::max(1.0f, std::abs(b));
+}
+
+bool Near(Vector3 a, Vector3 b, float tolerance) {
+    return Near(a.x, b.x, tolerance) && Near(a.y, b.y, tolerance) && Near(a.z, b.z, tolerance);
+}
+
+// Random particles around the origin, some on their way through the floor and some about to expire.
+// No life fraction lands within a step of 1, so both layouts agree on which expire.
+void Fill(ParticleStore& s, size_t n, std::mt19937& random) {
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f), ttl(0.5f, 2.0f), life(0.0f, 0.8f);
+    s.Push(n);
+    for (size_t i = 0; i < n; ++i) {
+        s.px[i] = 2.0f * unit(random);
+        s.py[i] = 0.5f + 1.5f * unit(random);
+        s.pz[i] = 2.0f * unit(random);
+        s.vx[i] = 3.0f * unit(random);
+        s.vy[i] = 3.0f * unit(random);
+        s.vz[i] = 3.0f * unit(random);
+        s.ox[i] = unit(random);
+        s.oy[i] = unit(random);
+        s.oz[i] = unit(random);
+        s.originAcceleration[i] = 0.5f + 0.5f * unit(random);
+        float lifetime = ttl(random);
+        s.invTtl[i] = 1.0f / lifetime;
+        s.age[i] = (i % 7 == 0 ? 1.1f : life(random)) * lifetime;
+        s.scale[i] = 1.0f;
+    }
+    s.px[3] = s.ox[3];  // Sits on its spawn origin: no pull
+    s.py[3] = s.oy[3];
+    s.pz[3] = s.oz[3];
+}
+
+// Runs the kernel over slots [begin, end) of `s` and the reference over `before`, a full store with
+// the same particles, and compares positions, velocities, scales and the expired lists
+void CompareKernel(ParticleStore& s, const ParticleStore& before, size_t begin, size_t end, const KernelParams& k,
+                   float tolerance, const std::string& name) {
+    std::vector<uint32_t> expired(end - begin);
+    BoundingBox bounds = ParticleKernel::EmptyBounds();
+    size_t count = ParticleKernel::Update(s, begin, end, k, expired.data(), bounds);
+    std::vector<uint32_t> dead;
+    bool same = true, inside = true;
+    for (size_t i = begin; i < end; ++i) {
+        Reference p = Load(before, i);
+        if (!Advance(p, k)) {
+            dead.push_back(static_cast<uint32_t>(i));
+            continue;
+        }
+        Vector3 position = s.Position(i);
+        Vector3 velocity = s.IsCompact()
+            ? Vector3{ rp3d::simd::HalfToFloat(s.packed.vx[i]), rp3d::simd::HalfToFloat(s.packed.vy[i]),
+                       rp3d::simd::HalfToFloat(s.packed.vz[i]) }
+            : Vector3{ s.vx[i], s.vy[i], s.vz[i] };
+        same = same && Near(position, p.position, tolerance) && Near(velocity, p.velocity, tolerance)
+            && Near(s.Scale(i), p.scale, tolerance);
+        inside = inside && position.x >= bounds.min.x && position.y >= bounds.min.y && position.z >= bounds.min.z
+            && position.x <= bounds.max.x && position.y <= bounds.max.y && position.z <= bounds.max.z;
+    }
+    Check(same, name + ": matches the reference");
+    Check(count == dead.size() && std::equal(dead.begin(), dead.end(), expired.begin()), name + ": expired list");
+    Check(inside, name + ": bounds");
+}
+
+// The arrays a compact store packs, positions first
+std::array<float*, 12> Fields(ParticleStore& s) {
+    return { s.px, s.py, s.pz, s.vx, s.vy, s.vz, s.ox, s.oy, s.oz, s.originAcceleration, s.age, s.invTtl };
+}
+
+void TestKernel() {
+    constexpr size_t n = 1003;  // Not a multiple of any lane width, so the scalar tail runs too
+    for (unsigned features = 0; features <= KernelAllFeatures; ++features) {
+        for (size_t begin : { size_t{ 0 }, ParticleStore::laneBlock }) {
+            std::mt19937 random(features);
+            ParticleStore s(n), before(n);
+            Fill(s, n, random);
+            random.seed(features);
+            Fill(before, n, random);
+            KernelParams k{ frameTime, 0.5f, { 0.1f, 0.2f, 0.3f }, { 0.5f, -0.2f, 0.1f }, true };
+            k.features = features;
+            CompareKernel(s, before, begin, n - 3, k, 1e-5f,
+                          "kernel, features " + std::to_string(features) + ", begin " + std::to_string(begin));
+        }
+    }
+
+    // The compact layout runs the same kernel on the particles as they were packed
+    std::mt19937 random(1);
+    ParticleStore full(n), s(n, std::pmr::get_default_resource(), ParticleLayout::Compact), before(n);
+    Fill(full, n, random);
+    s.origin = s.offsetOrigin = { 0.1f, 0.2f, 0.3f };
+    s.Push(n);
+    before.Push(n);
+    ParticleStore& scratch = ParticleStore::Scratch();
+    auto scratchFields = Fields(scratch), fullFields = Fields(full), beforeFields = Fields(before);
+    for (size_t b = 0; b < n; b += ParticleStore::scratchSize) {
+        size_t m = std::min(ParticleStore::scratchSize, n - b);
+        for (size_t f = 0; f < scratchFields.size(); ++f) {
+            std::copy_n(fullFields[f] + b, m, scratchFields[f]);
+        }
+        s.Pack(scratch, b, m, true);
+        s.Unpack(b, m, scratch);
+        for (size_t f = 3; f < scratchFields.size(); ++f) {
+            std::copy_n(scratchFields[f], m, beforeFields[f] + b);
+        }
+    }
+    std::copy_n(s.px, n, before.px);
+    std::copy_n(s.py, n, before.py);
+    std::copy_n(s.pz, n, before.pz);
+    KernelParams k{ frameTime, 0.5f, s.origin, { 0.5f, -0.2f, 0.1f }, true };
+    k.features = KernelAllFeatures;
+    CompareKernel(s, before, 0, n, k, 2e-3f, "kernel, compact");
+}
+
+// Remove keeps exactly the particles not listed, each with all its fields, whatever the order of the
+// list and however often an index repeats
+void TestRemove() {
+    constexpr size_t n = 100;
+    std::mt19937 random(3);
+    std::vector<std::vector<uint32_t>> lists = { {}, { 0 }, { 99 }, { 90, 91, 92, 93, 94, 95, 96, 97, 98, 99 },
+                                                 { 5, 99, 5, 0, 42, 99, 98 } };
+    std::vector<uint32_t> all(n);
+    std::iota(all.begin(), all.end(), 0u);
+    lists.push_back(all);
+    for (int r = 0; r < 20; ++r) {
+        std::vector<uint32_t> holes;
+        for (uint32_t i = 0; i < n; ++i) {
+            if (random() % 3 == 0) holes.push_back(i);
+        }
+        if (r % 2) {
+            // Unsorted with repeats
+            holes.insert(holes.end(), holes.begin(), holes.begin() + holes.size() / 2);
+            std::shuffle(holes.begin(), holes.end(), random);
+        }
+        lists.push_back(holes);
+    }
+    for (auto layout : { ParticleLayout::Full, ParticleLayout::Compact }) {
+        for (size_t l = 0; l < lists.size(); ++l) {
+            std::string name = std::string("remove, ") + LayoutName(layout) + ", list " + std::to_string(l);
+            ParticleStore s(n, std::pmr::get_default_resource(), layout);
+            s.Push(n);
+            for (size_t i = 0; i < n; ++i) {
+                s.px[i] = static_cast<float>(i);
+                if (s.IsCompact()) {
+                    s.packed.life[i] = static_cast<uint16_t>(i);
+                }
+                else {
+                    s.age[i] = static_cast<float>(i);
+                }
+            }
+            s.EnableHistory();
+            std::vector<uint32_t> holes = lists[l];
+            std::vector<bool> listed(n);
+            for (uint32_t i : holes) {
+                listed[i] = true;
+            }
+            s.Remove(holes.data(), holes.size());
+
+            std::vector<uint32_t> kept;
+            bool together = true;
+            for (size_t i = 0; i < s.Size(); ++i) {
+                kept.push_back(static_cast<uint32_t>(s.px[i]));
+                float other = s.IsCompact() ? s.packed.life[i] : s.age[i];
+                together = together && other == s.px[i] && s.prevX[i] == s.px[i];
+            }
+            std::sort(kept.begin(), kept.end());
+            std::vector<uint32_t> expected;
+            for (uint32_t i = 0; i < n; ++i) {
+                if (!listed[i]) expected.push_back(i);
+            }
+            Check(kept == expected, name + ": the unlisted particles are kept");
+            Check(together, name + ": fields move together");
+        }
+    }
+}
+
+// Emitter with a fixed 1 s lifetime that only spawns through Emitter::Spawn
+EmitterConfig OverflowConfig(OverflowPolicy policy, ParticleLayout layout) {
+    EmitterConfig c = BaseConfig(10);
+    c.age = { 1.0f, 1.0f };
+    c.burst = { 0, 0 };
+    c.emissionRate = 0;
+    c.layout = layout;
+    c.overflow.policy = policy;
+    return c;
+}
+
+// Every spawned particle is live, expired or killed, and only the policies that may drop do
+void TestOverflowCounts() {
+    for (auto policy : { OverflowPolicy::DropNew, OverflowPolicy::KillOldest, OverflowPolicy::Grow, OverflowPolicy::Defer }) {
+        EmitterConfig cfg = BaseConfig(100);
+        cfg.emissionRate = 1000;
+        cfg.burst = { 0, 0 };
+        cfg.overflow = { policy, 4000, 256, 0.5f };  // Room for every particle once grown
+        Emitter emitter(cfg);
+        emitter.Start();
+        size_t spawned = 0, retired = 0, dropped = 0, killed = 0;
+        bool balanced = true, bounded = true;
+        for (int f = 0; f < 180; ++f) {
+            unsigned long live = emitter.Update(frameTime);
+            const EmitterStats& stats = emitter.Stats();
+            spawned += stats.spawned;
+            retired += stats.expired + stats.killed;
+            dropped += stats.dropped;
+            killed += stats.killed;
+            bounded = bounded && live <= emitter.Capacity() && emitter.Capacity() <= emitter.MaxCapacity();
+            balanced = balanced && spawned == live + retired;
+        }
+        std::string name = "overflow " + std::to_string(static_cast<int>(policy));
+        Check(balanced, name + ": spawned = live + expired + killed");
+        Check(bounded, name + ": live within the capacity");
+        Check((dropped > 0) == (policy == OverflowPolicy::DropNew), name + ": dropped");
+        Check((killed > 0) == (policy == OverflowPolicy::KillOldest), name + ": killed");
+        Check((emitter.Capacity() > 100) == (policy == OverflowPolicy::Grow), name + ": grown");
+    }
+}
+
+// KillOldest removes the particles furthest into their lifetime: the survivors expire last
+void TestKillOldest() {
+    for (auto layout : { ParticleLayout::Full, ParticleLayout::Compact }) {
+        std::string name = std::string("kill oldest, ") + LayoutName(layout);
+        Emitter emitter(OverflowConfig(OverflowPolicy::KillOldest, layout));
+        emitter.Spawn(5);  // A
+        emitter.Update(0.25f);
+        emitter.Spawn(5);  // B
+        emitter.Update(0.25f);
+        Check(emitter.Spawn(5) == 5, name + ": spawn into a full emitter");  // C, kills A at age 0.5
+        unsigned long live = emitter.Update(0.25f);
+        Check(live == 10 && emitter.Stats().killed == 5 && emitter.Stats().dropped == 0, name + ": killed");
+        // B is 0.5 old and C 0.25: A would expire in this step, B in the next
+        emitter.Update(0.3f);
+        Check(emitter.Stats().expired == 0, name + ": none expired");
+        emitter.Update(0.3f);
+        Check(emitter.Stats().expired == 5, name + ": the oldest survivors expired");
+        emitter.Update(0.3f);
+        Check(emitter.Stats().expired == 5 && emitter.Stats().live == 0, name + ": the youngest expired");
+    }
+}
+
+// Grow adds whole pages up to maxCapacity, gives them back once idle and grows again
+void TestGrow() {
+    for (auto layout : { ParticleLayout::Full, ParticleLayout::Compact }) {
+        std::string name = std::string("grow, ") + LayoutName(layout);
+        EmitterConfig cfg = OverflowConfig(OverflowPolicy::Grow, layout);
+        cfg.capacity = 100;
+        cfg.overflow.maxCapacity = 1000;
+        cfg.overflow.page = 256;
+        cfg.overflow.shrinkDelay = 0.5f;
+        Emitter emitter(cfg);
+        emitter.EnableInterpolation();
+        Check(emitter.Capacity() == 100 && emitter.MaxCapacity() == 1000, name + ": initial capacity");
+        Check(emitter.Spawn(300) == 300 && emitter.Capacity() == 512, name + ": grows by pages");
+        Check(emitter.Spawn(800) == 700 && emitter.Capacity() == 1000, name + ": stops at maxCapacity");
+        emitter.Update(frameTime);
+        Check(emitter.Stats().dropped == 100 && emitter.Stats().live == 1000, name + ": drops past maxCapacity");
+
+        // A restored copy carries on bit for bit
+        std::vector<std::byte> state = Save(emitter);
+        Emitter copy(cfg);
+        copy.EnableInterpolation();
+        std::span<const std::byte> in(state);
+        Check(copy.RestoreState(in) && copy.Capacity() == 1000, name + ": restore a grown state");
+
+        size_t expired = 0;
+        for (int f = 0; f < 120; ++f) {
+            emitter.Update(frameTime);
+            copy.Update(frameTime);
+            expired += emitter.Stats().expired;
+        }
+        Check(Save(copy) == Save(emitter), name + ": restored copy matches");
+        Check(expired == 1000 && emitter.Stats().live == 0, name + ": grown slots expire");
+        Check(emitter.Capacity() == 100, name + ": shrinks back once idle");
+
+        Check(emitter.Spawn(600) == 600 && emitter.Capacity() == 768, name + ": grows again");
+        expired = 0;
+        for (int f = 0; f < 70; ++f) {
+            emitter.Update(frameTime);
+            expired += emitter.Stats().expired;
+        }
+        Check(expired == 600, name + ": particles on reused pages expire");
+    }
+}
+
+// A paged store keeps its arrays in place and their contents below the live count across
+// Reserve and Shrink, and the pages it gave back can be written again
+void TestPageReuse() {
+    for (auto layout : { ParticleLayout::Full, ParticleLayout::Compact }) {
+        std::string name = std::string("page reuse, ") + LayoutName(layout);
+        ParticleStore s(100, std::pmr::get_default_resource(), layout, 100000);
+        s.EnableHistory();
+        const float* px = s.px;
+        s.Reserve(50000);
+        size_t n = s.Push(50000) + 50000;
+        for (size_t i = 0; i < n; ++i) {
+            s.px[i] = s.prevX[i] = static_cast<float>(i);
+        }
+        std::vector<uint32_t> holes;
+        for (size_t i = 200; i < n; ++i) {
+            holes.push_back(static_cast<uint32_t>(i));
+        }
+        s.Remove(holes.data(), holes.size());
+        s.Shrink(256);
+        Check(s.Capacity() == 256 && s.Size() == 200 && s.px == px, name + ": shrinks in place");
+        s.Reserve(100000);
+        Check(s.Capacity() == 100000 && s.px == px, name + ": grows in place");
+        bool kept = true;
+        for (size_t i = 0; i < 200; ++i) {
+            kept = kept && s.px[i] == static_cast<float>(i) && s.prevX[i] == static_cast<float>(i);
+        }
+        Check(kept, name + ": live slots kept");
+        n = s.Push(s.Free()) + s.Free();
+        for (size_t i = 200; i < s.Size(); ++i) {
+            s.px[i] = s.prevX[i] = -static_cast<float>(i);
+        }
+        bool written = true;
+        for (size_t i = 200; i < s.Size(); ++i) {
+            written = written && s.px[i] == -static_cast<float>(i) && s.prevX[i] == -static_cast<float>(i);
+        }
+        Check(written && s.Size() == 100000, name + ": reused pages hold what is written");
+    }
+}
+
+}  // namespace
+
+int main() {
+    TestKernel();
+    TestRemove();
+    TestParallelEmitter();
+    TestParallelSystem();
+    TestOverflowCounts();
+    TestKillOldest();
+    TestGrow();
+    TestPageReuse();
+    if (failures == 0) {
+        std::cout << "all checks passed\n";
+    }
+    return failures;
+}